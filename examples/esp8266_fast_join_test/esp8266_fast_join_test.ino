@@ -0,0 +1,42 @@
+#include <EEPROM.h>
+#include <esp8266_lib.h>
+
+SoftwareSerial swSerial(8,9);
+Esp8266 esp8266(&swSerial);
+
+// join cache survives power cycles in EEPROM
+#define CACHE_ADDR 0
+
+void setup()
+{
+  Serial.begin(115200);
+  esp8266.begin();
+  
+  EEPROM.get(CACHE_ADDR, esp8266.joinCache());
+  // no DHCP; address must be free on the AP's network
+  esp8266.setStaticIP(IPAddress(192,168,0,50), IPAddress(192,168,0,1), IPAddress(255,255,255,0));
+}
+
+void loop()
+{
+  unsigned long start = millis();
+  if (esp8266.connectAPFast("MyAP", "MyPassword") > 0) {
+    Serial.print("joined in ");
+    Serial.print(esp8266.joinMillis());
+    Serial.println(" ms");
+    // BSSID learned on the first join
+    EEPROM.put(CACHE_ADDR, esp8266.joinCache());
+    
+    if (esp8266.tcpConnect(0, "192.168.0.2", 8000, 0) >= 0) {
+      esp8266.tcpWrite(0, "reading=42\n");
+      esp8266.tcpClose(0);
+    }
+    Serial.print("wake to sent ");
+    Serial.print(millis() - start);
+    Serial.println(" ms");
+  }
+  esp8266.disconnectAP();
+  
+  // stand-in for sleeping
+  delay(60000);
+}
@@ -0,0 +1,40 @@
+#include <esp8266_http_client.h>
+
+SoftwareSerial swSerial(8,9);
+Esp8266 esp8266(&swSerial);
+
+Esp8266HttpClient http;
+
+// body arrives in pieces as it is read; never held in RAM as a whole
+unsigned long bodyBytes;
+void onBody(const uint8_t * data, size_t len)
+{
+  Serial.write(data, len);
+  bodyBytes += len;
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  esp8266.begin();
+  
+  delay(1000);
+}
+
+void loop()
+{
+  // second and later requests go out on the same connection
+  int status = http.get("example.com", 80, "/");
+  Serial.print("status ");
+  Serial.println(status);
+  if (status > 0) {
+    bodyBytes = 0;
+    int32_t len = http.readBody(onBody);
+    Serial.println();
+    Serial.print(bodyBytes);
+    Serial.print(" bytes body, ");
+    Serial.println(len >= 0 ? "complete" : "failed");
+  }
+  
+  delay(10000);
+}
@@ -0,0 +1,52 @@
+#include <esp8266_http_server.h>
+
+SoftwareSerial swSerial(8,9);
+Esp8266 esp8266(&swSerial);
+
+// pages stay in flash and go out from there
+const char indexPath[] PROGMEM = "/";
+const char indexPage[] PROGMEM =
+  "<html><body><h1>Arduino</h1>"
+  "<a href=\"/led?on\">on</a> <a href=\"/led?off\">off</a>"
+  "</body></html>";
+const char ledPath[] PROGMEM = "/led";
+const char uptimePath[] PROGMEM = "/uptime";
+
+void led(Esp8266HttpServer & http)
+{
+  digitalWrite(LED_BUILTIN, strcmp(http.query(), "on") == 0 ? HIGH : LOW);
+  http.send(200, ESP8266_HTTP_TEXT, http.query());
+}
+
+void uptime(Esp8266HttpServer & http)
+{
+  http.beginResponse(200, ESP8266_HTTP_JSON);
+  http.print("{\"ms\":");
+  http.print(millis());
+  http.print("}");
+}
+
+const esp8266_http_route routes[] PROGMEM = {
+  { ESP8266_HTTP_GET, indexPath, NULL, ESP8266_HTTP_HTML,
+    (const uint8_t *)indexPage, sizeof(indexPage) - 1 },
+  { ESP8266_HTTP_GET, ledPath, led },
+  { ESP8266_HTTP_GET, uptimePath, uptime },
+};
+
+Esp8266HttpServer http(80, routes, ESP8266_HTTP_ROUTES(routes));
+
+void setup()
+{
+  Serial.begin(115200);
+  pinMode(LED_BUILTIN, OUTPUT);
+  esp8266.begin();
+  
+  delay(1000);
+  Serial.println(http.begin() ? "listening on 80" : "server failed");
+}
+
+void loop()
+{
+  esp8266.poll();
+  http.handle();
+}
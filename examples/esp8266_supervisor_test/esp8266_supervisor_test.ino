@@ -0,0 +1,39 @@
+#include <esp8266_supervisor.h>
+
+SoftwareSerial swSerial(8,9);
+Esp8266 esp8266(&swSerial);
+
+// rejoins AP and reconnects link 0 whenever either goes away
+Esp8266Supervisor supervisor;
+
+void setup()
+{
+  Serial.begin(115200);
+  esp8266.begin();
+  randomSeed(analogRead(0));
+  
+  supervisor.wifi("MyAP", "MyPassword");
+  supervisor.watch(0, "example.com", 80);
+}
+
+unsigned long lastReport;
+
+void loop()
+{
+  supervisor.handle();	// polls as well
+  
+  if (millis() - lastReport < 10000) return;
+  lastReport = millis();
+  
+  const esp8266_supervisor_stats & s = supervisor.getStats();
+  Serial.print(supervisor.up() ? "up" : "down");
+  Serial.print(", wifi drops ");
+  Serial.print(s.wifiDrops);
+  Serial.print(", link drops ");
+  Serial.print(s.linkDrops);
+  Serial.print(", failed attempts ");
+  Serial.print(s.failures);
+  Serial.print(", downtime ");
+  Serial.print(s.downtime);
+  Serial.println(" ms");
+}
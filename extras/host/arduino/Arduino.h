@@ -0,0 +1,57 @@
+/******************************************************************************
+Arduino.h - host stand-in for the parts of the Arduino core this library uses
+******************************************************************************/
+
+#ifndef __host_arduino_h__
+#define __host_arduino_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <strings.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// virtual clock; see host_clock.cpp
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+// flash is plain memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char *
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void * const *)(p))
+#define strlen_P strlen
+#define strncmp_P strncmp
+#define strcmp_P strcmp
+#define strcasecmp_P strcasecmp
+#define strstr_P strstr
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+
+#define DEC 10
+#define HEX 16
+
+// templates rather than the core's macros so that the C++ library still builds
+#include <algorithm>
+using std::min;
+using std::max;
+#define constrain(x,lo,hi) ((x)<(lo)?(lo):((x)>(hi)?(hi):(x)))
+
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+#endif
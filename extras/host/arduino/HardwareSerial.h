@@ -0,0 +1,23 @@
+#ifndef __host_hardware_serial_h__
+#define __host_hardware_serial_h__
+
+#include "Stream.h"
+
+// console: output goes to stdout (or nowhere when quiet), no input
+class HardwareSerial : public Stream
+{
+public:
+	void begin(unsigned long) {}
+	int available() { return 0; }
+	int read() { return -1; }
+	int peek() { return -1; }
+	size_t write(uint8_t c) { if (!quiet) fputc(c, stdout); return 1; }
+	using Print::write;
+	operator bool() { return true; }
+
+	bool quiet = false;
+};
+
+extern HardwareSerial Serial;
+
+#endif
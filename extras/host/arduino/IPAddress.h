@@ -0,0 +1,23 @@
+#ifndef __host_ipaddress_h__
+#define __host_ipaddress_h__
+
+#include <stdint.h>
+#include "Print.h"
+
+class IPAddress
+{
+public:
+	IPAddress() { memset(_a, 0, 4); }
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { _a[0] = a; _a[1] = b; _a[2] = c; _a[3] = d; }
+	IPAddress(uint32_t v) { memcpy(_a, &v, 4); }
+	IPAddress(const uint8_t * p) { memcpy(_a, p, 4); }
+	operator uint32_t() const { uint32_t v; memcpy(&v, _a, 4); return v; }
+	bool operator==(const IPAddress & o) const { return memcmp(_a, o._a, 4) == 0; }
+	bool operator!=(const IPAddress & o) const { return !(*this == o); }
+	uint8_t operator[](int i) const { return _a[i]; }
+	uint8_t & operator[](int i) { return _a[i]; }
+private:
+	uint8_t _a[4];
+};
+
+#endif
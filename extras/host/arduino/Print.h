@@ -0,0 +1,61 @@
+#ifndef __host_print_h__
+#define __host_print_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+class __FlashStringHelper;
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t * buf, size_t size)
+	{
+		size_t n = 0;
+		while (size--) n += write(*buf++);
+		return n;
+	}
+	size_t write(const char * s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+	size_t write(const char * buf, size_t size) { return write((const uint8_t *)buf, size); }
+	virtual void flush() {}
+
+	size_t print(const __FlashStringHelper * s) { return write((const char *)s); }
+	size_t print(const char * s) { return write(s); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = 10) { return print((unsigned long)n, base); }
+	size_t print(int n, int base = 10) { return print((long)n, base); }
+	size_t print(unsigned int n, int base = 10) { return print((unsigned long)n, base); }
+	size_t print(long n, int base = 10)
+	{
+		if (base == 10 && n < 0) return write('-') + print((unsigned long)-n, base);
+		return print((unsigned long)n, base);
+	}
+	size_t print(unsigned long n, int base = 10)
+	{
+		char buf[33];
+		char * p = buf + sizeof(buf) - 1;
+		*p = 0;
+		do {
+			unsigned d = n % base;
+			*--p = d < 10 ? '0' + d : 'A' + d - 10;
+			n /= base;
+		} while (n);
+		return write(p);
+	}
+	size_t print(double d, int digits = 2)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.*f", digits, d);
+		return write(buf);
+	}
+
+	size_t println() { return write("\r\n"); }
+	template <class T> size_t println(T x) { size_t n = print(x); return n + println(); }
+	template <class T> size_t println(T x, int base) { size_t n = print(x, base); return n + println(); }
+};
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef __host_server_h__
+#define __host_server_h__
+
+#include "Print.h"
+
+class Server : public Print
+{
+public:
+	virtual void begin() = 0;
+};
+
+#endif
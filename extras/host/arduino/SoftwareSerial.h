@@ -0,0 +1,21 @@
+#ifndef __host_software_serial_h__
+#define __host_software_serial_h__
+
+#include "Arduino.h"
+
+// same shape as the AVR core's, so that the SoftwareSerial path of the
+// library builds on the host; nothing is connected to it
+class SoftwareSerial : public Stream
+{
+public:
+	SoftwareSerial(uint8_t rx, uint8_t tx) { (void)rx; (void)tx; }
+	void begin(long baud) { (void)baud; }
+	bool overflow() { return false; }
+	virtual int available() { return 0; }
+	virtual int read() { return -1; }
+	virtual int peek() { return -1; }
+	virtual size_t write(uint8_t c) { (void)c; return 1; }
+	using Print::write;
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __host_stream_h__
+#define __host_stream_h__
+
+#include "Print.h"
+
+class Stream : public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/******************************************************************************
+dns_test.cpp
+
+DNS cache against the simulated ESP8266: tcpConnect() and resolve() by name
+ask ESP8266 once and then go by the cache until ESP8266_DNS_TTL, a name
+that did not resolve fails without asking for ESP8266_DNS_FAIL_TTL, and
+the entry closest to expiry makes room for a new name.
+******************************************************************************/
+
+#include <Arduino.h>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+int main()
+{
+	Serial.quiet = true;
+	sim.begin(115200);
+	CHECK(esp8266.begin(115200) >= 0);
+	
+	// first connect looks the name up, CIPSTART gets the address
+	CHECK(esp8266.tcpConnect(1, "example.com", 80, 0) >= 0);
+	CHECK(sim.dnsLookups == 1);
+	CHECK(sim.lastCommand == "AT+CIPSTART=1,\"TCP\",\"" + sim.dnsAddress + "\",80,0");
+	CHECK(esp8266.tcpClose(1) >= 0);
+	
+	// cached, whatever the case
+	IPAddress ip;
+	CHECK(esp8266.tcpConnect(1, "EXAMPLE.com", 80, 0) >= 0);
+	CHECK(esp8266.tcpClose(1) >= 0);
+	CHECK(esp8266.resolve("example.com", ip) == 0 && ip == IPAddress(93,184,216,34));
+	CHECK(sim.dnsLookups == 1);
+	
+	// addresses are never looked up
+	CHECK(esp8266.resolve("10.0.0.1", ip) == 0 && ip == IPAddress(10,0,0,1));
+	CHECK(sim.dnsLookups == 1);
+	
+	// TTL over: asked again, and the new answer is taken
+	delay(ESP8266_DNS_TTL - 1000);
+	CHECK(esp8266.resolve("example.com", ip) == 0);
+	CHECK(sim.dnsLookups == 1);
+	delay(1000);
+	sim.dnsAddress = "1.2.3.4";
+	CHECK(esp8266.resolve("example.com", ip) == 0 && ip == IPAddress(1,2,3,4));
+	CHECK(sim.dnsLookups == 2);
+	
+	// DNS Fail is remembered: no command at all until FAIL_TTL is over
+	CHECK(esp8266.tcpConnect(1, "host.invalid", 80, 0) == ESP8266_RSP_FAIL);
+	CHECK(sim.dnsLookups == 3);
+	unsigned long commands = sim.commands;
+	CHECK(esp8266.tcpConnect(1, "host.invalid", 80, 0) == ESP8266_RSP_FAIL);
+	CHECK(esp8266.resolve("host.invalid", ip) == ESP8266_RSP_FAIL);
+	CHECK(sim.commands == commands);
+	CHECK(esp8266.tcpState(1) == ESP8266_TCP_NONE);
+	delay(ESP8266_DNS_FAIL_TTL);
+	CHECK(esp8266.resolve("host.invalid", ip) == ESP8266_RSP_FAIL);
+	CHECK(sim.dnsLookups == 4);
+	
+	// an ERROR without DNS Fail (e.g. no AP) says nothing about the name
+	sim.script("AT+CIPDOMAIN", "\r\nERROR\r\n");
+	commands = sim.commands;
+	CHECK(esp8266.resolve("noap.org", ip) == ESP8266_RSP_FAIL);
+	CHECK(sim.commands == commands + 1);
+	sim.clearScripts();
+	CHECK(esp8266.resolve("noap.org", ip) == 0);
+	CHECK(sim.dnsLookups == 5);
+	
+	// full cache: the failed name expires first, so it goes, not
+	// example.com, which was resolved before it
+	delay(1000);
+	char name[16];
+	for (uint8_t i = 0; i < ESP8266_DNS_CACHE_LEN - 2; i++) {
+		snprintf(name, sizeof(name), "h%u.org", i);
+		CHECK(esp8266.resolve(name, ip) == 0);
+	}
+	unsigned long lookups = sim.dnsLookups;
+	CHECK(esp8266.resolve("example.com", ip) == 0);
+	CHECK(sim.dnsLookups == lookups);
+	CHECK(esp8266.resolve("host.invalid", ip) == ESP8266_RSP_FAIL);
+	CHECK(sim.dnsLookups == lookups + 1);
+	
+	printf("OK\n");
+	return 0;
+}
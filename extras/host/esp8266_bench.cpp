@@ -0,0 +1,306 @@
+/******************************************************************************
+esp8266_bench.cpp
+
+Performance benchmark of Esp8266 and Esp8266Client against the simulated
+ESP8266 (esp8266_sim.h).  Reports
+
+  - command latency: virtual time per blocking call, i.e. what a sketch
+    would wait on the wire and in the firmware
+  - TCP goodput: payload bytes per second of virtual time, both directions
+  - CPU per byte: host cpu time (library and simulator) and serial port
+    calls (available()/read()) the library makes per payload byte
+
+Virtual time makes the first two repeatable and independent of the host;
+the cpu figures are for spotting regressions relative to earlier runs on
+the same machine, not absolute MCU cost.
+
+Build and run (from this directory):
+
+	make bench
+	./esp8266_bench [baud]
+******************************************************************************/
+
+#include <Arduino.h>
+#include <time.h>
+#include <string>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "esp8266_lib.h"
+#include "esp8266_client.h"
+#include "esp8266_http_client.h"
+
+#define LATENCY_ROUNDS 20
+#define UPLOAD_BYTES 32768
+#define DOWNLOAD_BYTES 32768
+#define SEGMENT 1460		// what remote puts in one +IPD
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+static uint8_t payload[2048];
+
+static double cpuNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct sample {
+	unsigned long long t0;
+	double cpu0;
+	unsigned long long calls0;
+
+	void start()
+	{
+		t0 = hostMicros();
+		cpu0 = cpuNow();
+		calls0 = sim.serialCalls;
+	}
+	unsigned long long micros() { return hostMicros() - t0; }
+	double cpuNs() { return cpuNow() - cpu0; }
+	unsigned long long calls() { return sim.serialCalls - calls0; }
+};
+
+static bool failed = false;
+
+#define EXPECT(x) do { if (!(x)) { printf("  FAILED: %s (line %d)\n", #x, __LINE__); failed = true; return; } } while (0)
+
+template <class F>
+static void latency(const char * label, F fn)
+{
+	sample s;
+	s.start();
+	for (int i = 0; i < LATENCY_ROUNDS; i++) {
+		if (!fn()) {
+			printf("  %-26s FAILED\n", label);
+			failed = true;
+			return;
+		}
+	}
+	printf("  %-26s %9.1f ms\n", label, s.micros() / 1000.0 / LATENCY_ROUNDS);
+}
+
+static void goodput(const char * label, sample & s, size_t bytes)
+{
+	printf("  %-26s %9.0f B/s  %7.1f ns/B cpu  %5.2f serial calls/B\n", label,
+		bytes / (s.micros() / 1e6), s.cpuNs() / bytes, (double)s.calls() / bytes);
+}
+
+static void benchLatency()
+{
+	IPAddress ip;
+	char buf[64];
+
+	printf("command latency (average of %d)\n", LATENCY_ROUNDS);
+	latency("getLocalIP()", [&]() { return esp8266.getLocalIP(ip) >= 0; });
+	latency("getAP()", [&]() { return esp8266.getAP(buf) >= 0; });
+	latency("ping()", [&]() { return esp8266.ping("host") > 0; });
+	latency("tcpConnect()+tcpClose()", [&]() {
+		return esp8266.tcpConnect(4, "host", 80, 0) >= 0 && esp8266.tcpClose(4) >= 0;
+	});
+#if ESP8266_ENABLE_POOL
+	// a request each time, to the same backend
+	latency("Client connect()+stop()", [&]() {
+		Esp8266Client client;
+		bool ok = client.connect("host", 80) == 1;
+		client.stop();
+		return ok;
+	});
+	latency("  pooled", [&]() {
+		Esp8266Client client;
+		client.setPooling(true);
+		bool ok = client.connect("host", 80) == 1;
+		client.stop();
+		return ok;
+	});
+	esp8266.tcpPoolClose();
+#endif
+	sim.setPeer(Esp8266Sim::PEER_HTTP);
+	Esp8266HttpClient http;
+	latency("HTTP GET, 2 byte body", [&]() {
+		return http.get("host", 80, "/") == 200 && http.readBody(NULL) == 2;
+	});
+	http.stop();
+#if ESP8266_ENABLE_POOL
+	esp8266.tcpPoolClose();
+#endif
+	sim.setPeer(Esp8266Sim::PEER_SINK);
+	latency("tcpWrite() 16 bytes", [&]() {
+		static bool open = esp8266.tcpConnect(4, "host", 80, 0) >= 0;
+		return open && esp8266.tcpWrite(4, payload, 16) == 16;
+	});
+	esp8266.tcpClose(4);
+	
+	// battery devices: join, send, sleep
+	latency("connectAP()", [&]() { return esp8266.connectAP(sim.ssid, sim.password) > 0; });
+#if ESP8266_ENABLE_FAST_JOIN
+	esp8266.setStaticIP(IPAddress(192,168,0,50), IPAddress(192,168,0,1), IPAddress(255,255,255,0));
+	latency("  fast, static IP", [&]() { return esp8266.connectAPFast(sim.ssid, sim.password) > 0; });
+	esp8266.setStaticIP(IPAddress(0,0,0,0), IPAddress(0,0,0,0), IPAddress(0,0,0,0));
+	latency("  fast, DHCP", [&]() { return esp8266.connectAPFast(sim.ssid, sim.password) > 0; });
+#endif
+}
+
+static void uploadLib(size_t writeSize)
+{
+	EXPECT(esp8266.tcpConnect(4, "host", 80, 0) >= 0);
+	sim.peerData[4].clear();
+
+	sample s;
+	s.start();
+	for (size_t n = 0; n < UPLOAD_BYTES; n += writeSize)
+		EXPECT(esp8266.tcpWrite(4, payload, writeSize) == (int16_t)writeSize);
+	char label[40];
+	snprintf(label, sizeof(label), "tcpWrite() %u bytes", (unsigned)writeSize);
+	goodput(label, s, UPLOAD_BYTES);
+
+	EXPECT(sim.peerData[4].size() == UPLOAD_BYTES);
+	EXPECT(esp8266.tcpClose(4) >= 0);
+}
+
+static void downloadLib()
+{
+	EXPECT(esp8266.tcpConnect(4, "host", 80, 0) >= 0);
+
+	sample s;
+	s.start();
+	for (size_t n = 0; n < DOWNLOAD_BYTES; n += SEGMENT)
+		sim.remoteSend(4, payload, min((size_t)SEGMENT, (size_t)DOWNLOAD_BYTES - n));
+	size_t got = 0;
+	uint8_t buf[64];
+	while (got < DOWNLOAD_BYTES) {
+		int16_t n = esp8266.tcpRead(4, buf, sizeof(buf));
+		EXPECT(n >= 0);
+		got += n;
+	}
+	goodput("tcpRead() 64 bytes", s, DOWNLOAD_BYTES);
+
+	EXPECT(esp8266.tcpClose(4) >= 0);
+}
+
+#if ESP8266_ENABLE_PASSIVE_RECV
+// ESP8266 holds the payload and we fetch a ring full at a time
+static void downloadPassive()
+{
+	EXPECT(esp8266.tcpPassiveRecv(true) >= 0);
+	EXPECT(esp8266.tcpConnect(4, "host", 80, 0) >= 0);
+
+	sample s;
+	s.start();
+	sim.remoteSend(4, payload, sizeof(payload));
+	size_t got = 0;
+	uint8_t buf[64];
+	while (got < DOWNLOAD_BYTES) {
+		if (got % sizeof(payload) == 0 && got > 0)
+			sim.remoteSend(4, payload, sizeof(payload));
+		int16_t n = esp8266.tcpRead(4, buf, sizeof(buf));
+		EXPECT(n >= 0);
+		// fetches must not lose, repeat or reorder anything
+		EXPECT(memcmp(buf, payload + got % sizeof(payload), n) == 0);
+		got += n;
+	}
+	goodput("tcpRead() 64 bytes passive", s, DOWNLOAD_BYTES);
+
+	EXPECT(esp8266.tcpClose(4) >= 0);
+	EXPECT(esp8266.tcpPassiveRecv(false) >= 0);
+}
+#endif
+
+static void uploadClient()
+{
+	Esp8266Client client;
+	EXPECT(client.connect("host", 80) == 1);
+	uint8_t link = client.link();
+	sim.peerData[link].clear();
+
+	// the way libraries on top of Client write: short pieces
+	sample s;
+	s.start();
+	for (size_t n = 0; n < UPLOAD_BYTES; n += 16)
+		EXPECT(client.write(payload, 16) == 16);
+	client.flush();
+	goodput("Client write() 16 bytes", s, UPLOAD_BYTES);
+
+	EXPECT(sim.peerData[link].size() == UPLOAD_BYTES);
+	client.stop();
+}
+
+static void downloadClient()
+{
+	Esp8266Client client;
+	EXPECT(client.connect("host", 80) == 1);
+
+	sample s;
+	s.start();
+	for (size_t n = 0; n < DOWNLOAD_BYTES; n += SEGMENT)
+		sim.remoteSend(client.link(), payload, min((size_t)SEGMENT, (size_t)DOWNLOAD_BYTES - n));
+	size_t got = 0;
+	while (got < DOWNLOAD_BYTES) {
+		if (client.available() && client.read() >= 0)
+			got++;
+	}
+	goodput("Client read() by byte", s, DOWNLOAD_BYTES);
+
+	client.stop();
+}
+
+#if ESP8266_ENABLE_STATS
+// what the library itself saw over the whole run
+static void printStats()
+{
+	static const char * const names[ESP8266_CLASS_NUM] = {
+		"control", "wifi", "link", "send", "recv", "ping"
+	};
+	const esp8266_stats & s = esp8266.getStats();
+
+	printf("library stats\n");
+	printf("  serial %lu B in, %lu B out; payload %lu B in, %lu B out\n",
+		(unsigned long)s.rxBytes, (unsigned long)s.txBytes,
+		(unsigned long)s.tcpRxBytes, (unsigned long)s.tcpTxBytes);
+	printf("  %lu +IPD, %lu B discarded, %u overflows\n",
+		(unsigned long)s.ipdFrames, (unsigned long)s.discardedBytes, s.overflows);
+	for (int i = 0; i < ESP8266_CLASS_NUM; i++) {
+		const esp8266_cmd_stats & c = s.cmds[i];
+		if (c.count == 0) continue;
+		printf("  %-8s %6u cmds %4u failed  latency %8.1f /%8.1f /%8.1f ms min/avg/max\n",
+			names[i], c.count, c.failed + c.timeouts + c.unknown,
+			c.minMicros / 1000.0, c.totalMicros / 1000.0 / c.count, c.maxMicros / 1000.0);
+	}
+}
+#endif
+
+int main(int argc, char ** argv)
+{
+	long baud = argc > 1 ? atol(argv[1]) : 115200;
+
+	Serial.quiet = true;
+	for (size_t i = 0; i < sizeof(payload); i++) payload[i] = 'a' + i % 26;
+
+	sim.begin(baud);
+	if (esp8266.begin(baud) < 0) {
+		printf("begin failed\n");
+		return 1;
+	}
+	printf("%ld baud\n", baud);
+
+	benchLatency();
+
+	printf("TCP goodput\n");
+	uploadLib(64);
+	uploadLib(2048);
+	downloadLib();
+#if ESP8266_ENABLE_PASSIVE_RECV
+	downloadPassive();
+#endif
+	uploadClient();
+	downloadClient();
+#if ESP8266_ENABLE_STATS
+	printStats();
+#endif
+
+	if (sim.droppedBytes)
+		printf("simulator dropped %lu bytes (rx overflow)\n", sim.droppedBytes);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,483 @@
+/******************************************************************************
+esp8266_sim.cpp - see esp8266_sim.h
+******************************************************************************/
+
+#include <Arduino.h>
+#include "host_clock.h"
+#include "esp8266_sim.h"
+
+static void simBegin(Stream * stream, unsigned long baud)
+{
+	static_cast<Esp8266Sim *>(stream)->begin(baud);
+}
+
+static bool simOverflow(Stream * stream)
+{
+	return static_cast<Esp8266Sim *>(stream)->overflow();
+}
+
+const esp8266_transport_hooks esp8266SimHooks = { simBegin, simOverflow };
+
+Esp8266Sim::Esp8266Sim()
+{
+	for (int i = 0; i < SIM_MAX_LINKS; i++) linkOpen[i] = linkUdp[i] = false;
+}
+
+void Esp8266Sim::begin(long baud)
+{
+	_baud = baud;
+}
+
+// passthrough packs what MCU writes into a TCP segment once the uart has
+// been quiet for 20ms or 2048 bytes have come in; "+++" alone leaves data mode
+#define SIM_PACKET_GAP 20000
+
+void Esp8266Sim::sendPacket()
+{
+	packets++;
+	bytesToPeer += _packet.size();
+	peerData[0] += _packet;
+	peerReceive(0, _packet);
+	_packet.clear();
+}
+
+void Esp8266Sim::peerReceive(int link, const std::string & data)
+{
+	if (_peer == PEER_ECHO) {
+		remoteSend(link, data.data(), data.size());
+	} else if (_peer == PEER_HTTP) {
+		_httpIn[link] += data;
+		size_t end;
+		while ((end = _httpIn[link].find("\r\n\r\n")) != std::string::npos) {
+			_httpIn[link].erase(0, end + 4);
+			httpRequests++;
+			remoteSend(link, httpResponse.data(), httpResponse.size());
+		}
+	}
+}
+
+// move bytes that are on the wire by now into the rx buffer
+void Esp8266Sim::pump()
+{
+	unsigned long long now = hostMicros();
+	if (_passthrough && !_packet.empty() && now - _lastWrite >= SIM_PACKET_GAP) {
+		if (_escape && _packet == "+++") {
+			_packet.clear();
+			_passthrough = false;
+		} else {
+			sendPacket();
+		}
+	}
+
+	if (_nextBaud && now >= _nextBaudAt) {
+		espBaud = _nextBaud;
+		_nextBaud = 0;
+	}
+	while (!_wire.empty() && _wire.front().t <= now) {
+		uint8_t c = _wire.front().c;
+		if (_wire.front().rate != _baud)
+			c = (c ^ 0x5a) | 0x80;		// wrong rate, garbage
+		if (maxReliableBaud && _baud > maxReliableBaud && ++_noise % noiseInterval == 0) {
+			_overflow = true;
+			droppedBytes++;
+		} else if (_rx.size() < rxBufferSize) {
+			_rx.push_back(c);
+		} else {
+			_overflow = true;
+			droppedBytes++;
+		}
+		_wire.pop_front();
+	}
+}
+
+int Esp8266Sim::available()
+{
+	serialCalls++;
+	hostAdvance(HOST_CALL_COST_US);
+	pump();
+	return _rx.size();
+}
+
+int Esp8266Sim::read()
+{
+	serialCalls++;
+	pump();
+	if (_rx.empty()) return -1;
+	uint8_t c = _rx.front();
+	_rx.pop_front();
+	return c;
+}
+
+int Esp8266Sim::peek()
+{
+	serialCalls++;
+	pump();
+	return _rx.empty() ? -1 : _rx.front();
+}
+
+void Esp8266Sim::emit(const char * s, size_t len, unsigned long delay)
+{
+	unsigned long long t = hostMicros() + delay;
+	if (t < _wireFree) t = _wireFree;
+	long rate = espRate();
+	for (size_t i = 0; i < len; i++) {
+		t += 10000000ULL / rate + byteGap;
+		_wire.push_back(timed_byte{ t, (uint8_t)s[i], rate });
+	}
+	_wireFree = t;
+}
+
+void Esp8266Sim::emit(const std::string & s, unsigned long delay)
+{
+	emit(s.data(), s.size(), delay);
+}
+
+// the library's SoftwareSerial write is bit banged and blocks
+size_t Esp8266Sim::write(uint8_t c)
+{
+	hostAdvance(byteTime());
+	pump();
+
+	// module can't make sense of it
+	if (espRate() != _baud) return 1;
+
+	if (_passthrough) {
+		if (_packet.empty())
+			_escape = hostMicros() - _lastWrite >= SIM_PACKET_GAP;
+		_lastWrite = hostMicros();
+		_packet += (char)c;
+		if (_packet.size() == 2048) sendPacket();
+		return 1;
+	}
+	_lastWrite = hostMicros();
+
+	if (_sendLink >= 0) {
+		_sendData += (char)c;
+		if (--_sendLeft == 0) sendDone();
+		return 1;
+	}
+
+	if (echo) emit((const char *)&c, 1, 0);
+	_line += (char)c;
+	if (c == '\n') {
+		std::string line = _line;
+		_line.clear();
+		while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+			line.pop_back();
+		if (!line.empty()) command(line);
+	}
+	return 1;
+}
+
+void Esp8266Sim::sendDone()
+{
+	int link = _sendLink;
+	_sendLink = -1;
+	bytesToPeer += _sendData.size();
+	peerData[link] += _sendData;
+	if (linkUdp[link]) {
+		datagrams[link].push_back(_sendData);
+		datagramTo[link] = _sendTo;
+	}
+	char buf[40];
+	snprintf(buf, sizeof(buf), "\r\nRecv %u bytes\r\n", (unsigned)_sendData.size());
+	emit(buf, cmdLatency);
+	emit("\r\nSEND OK\r\n", sendLatency);
+	peerReceive(link, _sendData);
+	_sendData.clear();
+}
+
+// "<link>," in multiple connection mode
+std::string Esp8266Sim::prefix(int link)
+{
+	return _mux ? std::to_string(link) + "," : std::string();
+}
+
+static bool startsWith(const std::string & s, const char * prefix)
+{
+	return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// field i (0 based) of comma separated parameter list, quotes stripped
+static std::string field(const std::string & params, int i)
+{
+	size_t start = 0;
+	while (i-- > 0) {
+		start = params.find(',', start);
+		if (start == std::string::npos) return "";
+		start++;
+	}
+	size_t end = params.find(',', start);
+	std::string f = params.substr(start, end == std::string::npos ? std::string::npos : end - start);
+	if (f.size() >= 2 && f.front() == '"' && f.back() == '"')
+		f = f.substr(1, f.size() - 2);
+	return f;
+}
+
+void Esp8266Sim::command(const std::string & line)
+{
+	commands++;
+	lastCommand = line;
+	if (logCommands) commandLog.push_back(line);
+	if (verbose) fprintf(stderr, "[sim %llu] %s\n", hostMicros(), line.c_str());
+
+	for (size_t i = _scripts.size(); i-- > 0; ) {
+		if (startsWith(line, _scripts[i].prefix.c_str())) {
+			emit(_scripts[i].response, _scripts[i].delay);
+			return;
+		}
+	}
+
+	std::string params;
+	size_t eq = line.find('=');
+	if (eq != std::string::npos) params = line.substr(eq + 1);
+
+	if (line == "AT") {
+		emit("\r\nOK\r\n", cmdLatency);
+	} else if (line == "ATE0" || line == "ATE1") {
+		emit("\r\nOK\r\n", cmdLatency);
+		echo = (line == "ATE1");
+	} else if (line == "AT+GMR") {
+		emit("AT version:1.1.0.0(May 11 2016 18:09:56)\r\n"
+			"SDK version:1.5.4(baaeaebb)\r\n"
+			"compile time:May 20 2016 15:06:44\r\n"
+			"OK\r\n", cmdLatency);
+	} else if (startsWith(line, "AT+CIPMUX=")) {
+		bool busy = false;
+		for (int i = 0; i < SIM_MAX_LINKS; i++) busy |= linkOpen[i];
+		if (busy) {
+			emit("link is builded\r\n\r\nERROR\r\n", cmdLatency);
+		} else if (_cipmode && params == "1") {
+			emit("\r\nERROR\r\n", cmdLatency);
+		} else {
+			_mux = (params == "1");
+			emit("\r\nOK\r\n", cmdLatency);
+		}
+	} else if (startsWith(line, "AT+CWJAP_CUR=")) {
+		std::string ap = field(params, 2);
+		if (!ap.empty() && ap != bssid) {
+			// no such AP around
+			emit("+CWJAP:3\r\n\r\nFAIL\r\n", joinLatency / 2);
+		} else if (field(params, 0) == ssid && field(params, 1) == password) {
+			_joined = true;
+			// delays count from now: associated half way, DHCP takes the rest
+			emit("WIFI CONNECTED\r\n", joinLatency / 2);
+			emit("WIFI GOT IP\r\n", staticIp.empty() ? joinLatency : joinLatency / 2 + cmdLatency);
+			emit("\r\nOK\r\n", cmdLatency);
+		} else {
+			emit("+CWJAP:1\r\n\r\nFAIL\r\n", joinLatency);
+		}
+	} else if (line == "AT+CWJAP_CUR?") {
+		if (_joined)
+			emit(std::string("+CWJAP_CUR:\"") + ssid + "\",\"" + bssid + "\"," + std::to_string(channel) + ",-45\r\n\r\nOK\r\n", cmdLatency);
+		else
+			emit("No AP\r\n\r\nOK\r\n", cmdLatency);
+	} else if (line == "AT+CWQAP") {
+		_joined = false;
+		emit("\r\nOK\r\n", cmdLatency);
+		emit("WIFI DISCONNECT\r\n", 100000);
+	} else if (startsWith(line, "AT+CIPSTA_CUR=")) {
+		staticIp = field(params, 0);
+		emit("\r\nOK\r\n", cmdLatency);
+	} else if (line == "AT+CWDHCP_CUR=1,1") {
+		staticIp.clear();
+		emit("\r\nOK\r\n", cmdLatency);
+	} else if (line == "AT+CIFSR") {
+		emit("+CIFSR:STAIP,\"192.168.0.114\"\r\n"
+			"+CIFSR:STAMAC,\"18:fe:34:9d:b7:d9\"\r\n"
+			"\r\nOK\r\n", cmdLatency);
+	} else if (line == "AT+CIPSTAMAC?") {
+		emit("+CIPSTAMAC:\"18:fe:34:9d:b7:d9\"\r\n\r\nOK\r\n", cmdLatency);
+	} else if (startsWith(line, "AT+UART_CUR=")) {
+		long rate = atol(field(params, 0).c_str());
+		if (rate < 110 || rate > 4608000) {
+			emit("\r\nERROR\r\n", cmdLatency);
+		} else {
+			emit("\r\nOK\r\n", cmdLatency);
+			_nextBaud = rate;
+			_nextBaudAt = _wireFree;
+		}
+	} else if (startsWith(line, "AT+CIPMODE=")) {
+		if (_mux && params == "1") {
+			emit("\r\nERROR\r\n", cmdLatency);
+		} else {
+			_cipmode = (params == "1");
+			emit("\r\nOK\r\n", cmdLatency);
+		}
+	} else if (line == "AT+CIPSEND") {
+		if (!_cipmode || _mux || !linkOpen[0]) {
+			emit("\r\nERROR\r\n", cmdLatency);
+		} else {
+			_passthrough = true;
+			_packet.clear();
+			emit("\r\nOK\r\n\r\n>", cmdLatency);
+		}
+	} else if (startsWith(line, "AT+CIPSTART=")) {
+		// single connection mode has no link id
+		int link = _mux ? atoi(field(params, 0).c_str()) : 0;
+		std::string host = field(params, _mux ? 2 : 1);
+		bool udp = field(params, _mux ? 1 : 0) == "UDP";
+		if (link < 0 || link >= SIM_MAX_LINKS) {
+			emit("ID ERROR\r\n\r\nERROR\r\n", cmdLatency);
+		} else if (linkOpen[link]) {
+			emit("ALREADY CONNECTED\r\n\r\nERROR\r\n", cmdLatency);
+		} else if (host.find("invalid") != std::string::npos) {
+			dnsLookups++;
+			emit("DNS Fail\r\n\r\nERROR\r\n", dnsLatency);
+		} else {
+			// a name is looked up on the way
+			unsigned long latency = udp ? cmdLatency : connectLatency;
+			if (!isdigit(host[0])) {
+				dnsLookups++;
+				latency += dnsLatency;
+			}
+			linkOpen[link] = true;
+			linkUdp[link] = udp;
+			peerData[link].clear();
+			_httpIn[link].clear();
+			datagrams[link].clear();
+			// UDP has nothing to set up
+			emit(prefix(link) + "CONNECT\r\n\r\nOK\r\n", latency);
+		}
+	} else if (startsWith(line, "AT+CIPSEND=")) {
+		int link = _mux ? atoi(field(params, 0).c_str()) : 0;
+		int len = atoi(field(params, _mux ? 1 : 0).c_str());
+		sendCommands++;
+		if (link < 0 || link >= SIM_MAX_LINKS || !linkOpen[link]) {
+			emit("link is not valid\r\n\r\nERROR\r\n", cmdLatency);
+		} else if (len <= 0 || len > 2048) {
+			emit("\r\nERROR\r\n", cmdLatency);
+		} else if (!field(params, 2).empty() && !isdigit(field(params, 2)[0])) {
+			// datagram remote must be an address, firmware does not resolve it
+			emit("\r\nERROR\r\n", cmdLatency);
+		} else {
+			_sendLink = link;
+			_sendLeft = len;
+			_sendTo = field(params, 2) + ":" + field(params, 3);
+			emit("\r\nOK\r\n> ", cmdLatency);
+		}
+	} else if (startsWith(line, "AT+CIPCLOSE")) {
+		int link = _mux ? atoi(params.c_str()) : 0;
+		if (link < 0 || link >= SIM_MAX_LINKS || !linkOpen[link]) {
+			emit("UNLINK\r\n\r\nERROR\r\n", cmdLatency);
+		} else {
+			linkOpen[link] = false;
+			_held[link].clear();
+			_pending[link].clear();
+			emit(prefix(link) + "CLOSED\r\n\r\nOK\r\n", cmdLatency);
+		}
+	} else if (startsWith(line, "AT+CIPDINFO=")) {
+		_ipdInfo = (params == "1");
+		emit("\r\nOK\r\n", cmdLatency);
+	} else if (startsWith(line, "AT+CIPRECVMODE=")) {
+		_recvPassive = (params == "1");
+		emit("\r\nOK\r\n", cmdLatency);
+		// whatever is held goes out the active way
+		for (int i = 0; !_recvPassive && i < SIM_MAX_LINKS; i++) {
+			std::string data = _held[i] + _pending[i];
+			_held[i].clear();
+			_pending[i].clear();
+			if (!data.empty()) remoteSend(i, data.data(), data.size());
+		}
+	} else if (startsWith(line, "AT+CIPRECVDATA=")) {
+		int link = atoi(field(params, 0).c_str());
+		size_t len = atoi(field(params, 1).c_str());
+		recvCommands++;
+		if (!_recvPassive || link < 0 || link >= SIM_MAX_LINKS || _held[link].empty()) {
+			emit("\r\nERROR\r\n", cmdLatency);
+		} else {
+			std::string data = _held[link].substr(0, len);
+			_held[link].erase(0, data.size());
+			emit("+CIPRECVDATA," + std::to_string(data.size()) + ":" + data + "\r\nOK\r\n", cmdLatency);
+			hold(link);
+		}
+	} else if (line == "AT+CIPRECVLEN?") {
+		std::string lens;
+		for (int i = 0; i < SIM_MAX_LINKS; i++)
+			lens += (i ? "," : "") + std::to_string(_held[i].size());
+		emit("+CIPRECVLEN:" + lens + "\r\n\r\nOK\r\n", cmdLatency);
+	} else if (startsWith(line, "AT+CIPSERVER=")) {
+		emit("\r\nOK\r\n", cmdLatency);
+	} else if (startsWith(line, "AT+CIPDOMAIN=")) {
+		dnsLookups++;
+		if (params.find("invalid") != std::string::npos)
+			emit("DNS Fail\r\n\r\nERROR\r\n", dnsLatency);
+		else
+			emit("+CIPDOMAIN:" + dnsAddress + "\r\n\r\nOK\r\n", dnsLatency);
+	} else if (startsWith(line, "AT+PING=")) {
+		if (params.find("invalid") != std::string::npos)
+			emit("+timeout\r\n\r\nERROR\r\n", 1000000);
+		else
+			emit("+12\r\n\r\nOK\r\n", 12000);
+	} else {
+		emit("\r\nERROR\r\n", cmdLatency);
+	}
+}
+
+void Esp8266Sim::script(const char * prefix, const char * response, unsigned long delay)
+{
+	_scripts.push_back(scripted{ prefix, response, delay });
+}
+
+void Esp8266Sim::remoteConnect(uint8_t link)
+{
+	linkOpen[link] = true;
+	peerData[link].clear();
+	emit(prefix(link) + "CONNECT\r\n");
+}
+
+void Esp8266Sim::remoteSend(uint8_t link, const void * data, size_t len)
+{
+	bytesFromPeer += len;
+	if (_passthrough) {
+		emit((const char *)data, len, 0);
+		return;
+	}
+	if (_recvPassive && !linkUdp[link]) {
+		_pending[link].append((const char *)data, len);
+		hold(link);
+		return;
+	}
+	std::string from;
+	if (_ipdInfo) from = "," + remoteIP + "," + std::to_string(remotePort);
+	emit("\r\n+IPD," + prefix(link) + std::to_string(len) + from + ":");
+	emit((const char *)data, len, 0);
+}
+
+void Esp8266Sim::cutFrame(uint8_t link, const char * s, size_t len)
+{
+	emit("\r\n+IPD," + prefix(link) + std::to_string(len) + ":");
+	emit(s, strlen(s), 0);
+}
+
+// passive receive: take in what the peer has sent as far as there is room,
+// a segment at a time, and announce each
+void Esp8266Sim::hold(uint8_t link)
+{
+	while (!_pending[link].empty() && _held[link].size() < heldMax) {
+		size_t n = std::min(std::min(_pending[link].size(), (size_t)1460), heldMax - _held[link].size());
+		_held[link] += _pending[link].substr(0, n);
+		_pending[link].erase(0, n);
+		emit("+IPD," + std::to_string(link) + "," + std::to_string(n) + "\r\n");
+	}
+}
+
+void Esp8266Sim::remoteClose(uint8_t link)
+{
+	linkOpen[link] = false;
+	// in passthrough mode firmware keeps quiet (and tries to reconnect)
+	if (!_passthrough)
+		emit(prefix(link) + "CLOSED\r\n");
+}
+
+void Esp8266Sim::wifiDrop()
+{
+	_joined = false;
+	for (int i = 0; i < SIM_MAX_LINKS; i++) {
+		if (linkOpen[i]) {
+			linkOpen[i] = false;
+			emit(prefix(i) + "CLOSED\r\n");
+		}
+	}
+	emit("WIFI DISCONNECT\r\n");
+}
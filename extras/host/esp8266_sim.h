@@ -0,0 +1,166 @@
+/******************************************************************************
+esp8266_sim.h - scripted ESP8266 AT firmware for host runs
+
+Stands in for the serial port the library talks to; it is a plain Stream,
+hand esp8266SimHooks to the Esp8266 constructor along with it.  Commands written by
+the library are parsed line by line and answered the way AT firmware 1.x
+does, with every byte delivered at the configured baud rate on the virtual
+clock.  The receive side behaves like SoftwareSerial: a small buffer that
+drops bytes and sets overflow() when it is not read in time.
+
+Remote peers are simulated per link: tests inject connects, payload and
+closes, and data sent by the library is handed to the peer (sink or echo).
+In passive receive mode (CIPRECVMODE=1) TCP payload is held, up to
+heldMax bytes per link; beyond that the peer is flow controlled and the
+rest goes in as the library fetches with CIPRECVDATA.
+******************************************************************************/
+
+#ifndef __esp8266_sim_h__
+#define __esp8266_sim_h__
+
+#include <Arduino.h>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include "esp8266_transport.h"
+
+#define SIM_MAX_LINKS 5
+
+class Esp8266Sim : public Stream
+{
+public:
+	Esp8266Sim();
+
+	// what a SoftwareSerial would do; see esp8266SimHooks
+	void begin(long baud);
+	bool overflow() { bool o = _overflow; _overflow = false; return o; }
+
+	// Stream
+	int available();
+	int read();
+	int peek();
+	size_t write(uint8_t c);
+	using Print::write;
+
+	// remote peer behaviour
+	// PEER_HTTP answers every request (headers up to the blank line; any
+	// body is ignored) with httpResponse
+	enum peer_mode { PEER_SINK, PEER_ECHO, PEER_HTTP };
+	void setPeer(peer_mode mode) { _peer = mode; }
+	std::string httpResponse = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+	unsigned long httpRequests = 0;
+
+	// things happening on the far side
+	void remoteConnect(uint8_t link);
+	void remoteSend(uint8_t link, const void * data, size_t len);
+	void remoteSend(uint8_t link, const char * s) { remoteSend(link, s, strlen(s)); }
+	// sender reported in +IPD once CIPDINFO=1
+	std::string remoteIP = "192.168.0.2";
+	unsigned remotePort = 7;
+	void remoteClose(uint8_t link);
+	void wifiDrop();
+	// +IPD announcing len bytes of which only s arrives, as when the
+	// module resets in the middle of a frame
+	void cutFrame(uint8_t link, const char * s, size_t len);
+
+	// answer commands starting with prefix with response instead of the
+	// built in behaviour; later scripts win
+	void script(const char * prefix, const char * response, unsigned long delay = 0);
+	void clearScripts() { _scripts.clear(); }
+
+	// timing knobs (micro seconds)
+	unsigned long cmdLatency = 200;		// command turnaround
+	unsigned long connectLatency = 20000;	// CIPSTART
+	unsigned long dnsLatency = 50000;	// CIPDOMAIN, or CIPSTART by name on top
+	unsigned long sendLatency = 2000;	// CIPSEND payload to SEND OK
+	unsigned long joinLatency = 2000000;	// CWJAP; second half is DHCP
+	unsigned int rxBufferSize = 64;		// SoftwareSerial _SS_MAX_RX_BUFF
+	unsigned long byteGap = 0;		// extra idle time after each byte to MCU
+	size_t heldMax = 2920;			// passive receive buffer per link
+
+	// baud rates: module runs at espBaud (0: whatever the MCU side was set
+	// to with begin()); bytes sent at a rate the other side is not at turn
+	// into garbage.  Above maxReliableBaud every noiseInterval-th byte to the
+	// MCU is lost, as with a serial port that can't keep up.
+	long espBaud = 0;
+	long maxReliableBaud = 0;
+	unsigned int noiseInterval = 23;
+
+	// what happened
+	const char * ssid = "sim";
+	const char * password = "secret";
+	const char * bssid = "00:aa:bb:cc:dd:ee";	// the one AP there is
+	int channel = 6;
+	std::string staticIp;			// CIPSTA_CUR address; "" for DHCP
+	unsigned long commands = 0;		// AT commands received
+	unsigned long sendCommands = 0;		// CIPSEND commands
+	unsigned long long bytesToPeer = 0;	// payload delivered to remote peers
+	unsigned long long bytesFromPeer = 0;	// payload injected by remote peers
+	unsigned long droppedBytes = 0;		// rx overflow
+	unsigned long long serialCalls = 0;	// available()/read()/peek() by the library
+	unsigned long packets = 0;		// TCP segments sent to peers
+	std::string lastCommand;
+	bool logCommands = false;
+	std::vector<std::string> commandLog;	// with logCommands, every command
+	std::string peerData[SIM_MAX_LINKS];	// what each peer received
+	std::vector<std::string> datagrams[SIM_MAX_LINKS];	// UDP links: same, per datagram
+	std::string datagramTo[SIM_MAX_LINKS];	// UDP links: "ip:port" of last one
+	bool linkOpen[SIM_MAX_LINKS];
+	bool linkUdp[SIM_MAX_LINKS];
+	unsigned long recvCommands = 0;		// CIPRECVDATA commands
+	unsigned long dnsLookups = 0;		// by CIPDOMAIN or CIPSTART with a name
+	std::string dnsAddress = "93.184.216.34";	// what every name resolves to
+	bool echo = true;
+	bool passthrough() { return _passthrough; }
+	bool verbose = false;
+
+private:
+	void pump();
+	void emit(const std::string & s, unsigned long delay = 0);
+	void emit(const char * s, size_t len, unsigned long delay);
+	void command(const std::string & line);
+	void sendDone();
+	void peerReceive(int link, const std::string & data);
+	void hold(uint8_t link);
+	std::string prefix(int link);
+	unsigned long byteTime() { return 10000000UL / _baud; }
+	long espRate() { return espBaud ? espBaud : _baud; }
+
+	struct timed_byte { unsigned long long t; uint8_t c; long rate; };
+	std::deque<timed_byte> _wire;		// on its way to the MCU
+	std::deque<uint8_t> _rx;			// arrived, in SoftwareSerial buffer
+	unsigned long long _wireFree = 0;	// when the wire is idle again
+	bool _overflow = false;
+	long _baud = 9600;
+	long _nextBaud = 0;				// AT+UART_CUR takes effect once OK is out
+	unsigned long long _nextBaudAt = 0;
+	unsigned long _noise = 0;
+
+	struct scripted { std::string prefix, response; unsigned long delay; };
+	std::vector<scripted> _scripts;
+
+	std::string _line;			// command being received
+	int _sendLink = -1;			// CIPSEND payload expected for link
+	size_t _sendLeft = 0;
+	std::string _sendData;
+	bool _mux = false;
+	bool _cipmode = false;
+	bool _ipdInfo = false;			// CIPDINFO=1
+	bool _recvPassive = false;		// CIPRECVMODE=1
+	std::string _held[SIM_MAX_LINKS];	// passive: received, not fetched yet
+	std::string _pending[SIM_MAX_LINKS];	// passive: peer is held off
+	std::string _sendTo;			// CIPSEND remote of UDP datagram
+	bool _passthrough = false;			// CIPMODE=1 data mode
+	unsigned long long _lastWrite = 0;	// when MCU wrote last byte
+	bool _escape = false;			// current packet followed a quiet line
+	std::string _packet;				// passthrough bytes not sent yet
+	void sendPacket();
+	bool _joined = false;
+	peer_mode _peer = PEER_SINK;
+	std::string _httpIn[SIM_MAX_LINKS];	// PEER_HTTP: request so far
+};
+
+extern const esp8266_transport_hooks esp8266SimHooks;
+
+#endif
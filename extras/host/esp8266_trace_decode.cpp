@@ -0,0 +1,178 @@
+/******************************************************************************
+esp8266_trace_decode.cpp
+
+Turns trace dumps (esp8266TraceDump(), see esp8266_trace.h) into a
+timeline.  Reads a serial log from stdin or the files given, skips
+everything that is not part of a dump, and prints each dump as
+
+	   time ms   +delta  what
+
+with times relative to the oldest entry.
+
+Build and run (from this directory):
+
+	make esp8266_trace_decode
+	./esp8266_trace_decode serial.log
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "esp8266_trace.h"
+#include "esp8266_lib.h"
+
+// by Esp8266::esp8266_op number
+static const char * const opNames[] = {
+	"none", "AT", "ATE", "CIPMUX", "GMR", "CWJAP", "CWJAP?", "CWQAP",
+	"CIFSR", "CIPSTAMAC?", "CIPSTART", "CIPSEND", "CIPCLOSE", "CIPSERVER",
+	"PING", "CIPMODE", "CIPSEND passthrough", "UART_CUR", "CIPSTART UDP",
+	"CIPRECVMODE", "CIPRECVDATA", "CIPRECVLEN?", "CIPDOMAIN"
+};
+
+// by esp8266_event_type
+static const char * const eventNames[] = {
+	"CONNECT", "CLOSED", "+IPD", "WIFI DISCONNECT", "WIFI GOT IP", "busy",
+	"SEND OK", "SEND FAIL"
+};
+
+static const char * opName(unsigned op)
+{
+	static char buf[16];
+	if (op < sizeof(opNames) / sizeof(opNames[0])) return opNames[op];
+	snprintf(buf, sizeof(buf), "op %u", op);
+	return buf;
+}
+
+// the rest leave link 0
+static bool opHasLink(unsigned op)
+{
+	const char * name = opName(op);
+	return strncmp(name, "CIPSTART", 8) == 0 || strcmp(name, "CIPSEND") == 0
+		|| strcmp(name, "CIPCLOSE") == 0 || strcmp(name, "CIPRECVDATA") == 0;
+}
+
+static const char * resultName(int16_t result)
+{
+	static char buf[16];
+	switch (result) {
+	case ESP8266_RSP_PENDING: return "pending";
+	case ESP8266_CMD_BAD: return "bad command";
+	case ESP8266_RSP_MEMORY_ERR: return "memory error";
+	case ESP8266_RSP_FAIL: return "FAIL";
+	case ESP8266_RSP_UNKNOWN: return "unknown response";
+	case ESP8266_RSP_TIMEOUT: return "timeout";
+	}
+	snprintf(buf, sizeof(buf), "ok (%d)", result);
+	return buf;
+}
+
+static void describe(const esp8266_trace_entry & e, char * out, size_t len)
+{
+	unsigned link = e.a >> 4;
+	switch (e.type) {
+	case ESP8266_TRACE_CMD:
+		if (opHasLink(e.a))
+			snprintf(out, len, "-> %s link %u", opName(e.a), e.b);
+		else
+			snprintf(out, len, "-> %s", opName(e.a));
+		break;
+	case ESP8266_TRACE_MATCH:
+		snprintf(out, len, "<- %s %s", opName(e.a), (e.b & ESP8266_MATCH(0)) ? "pass token" : "fail token");
+		break;
+	case ESP8266_TRACE_DONE:
+		snprintf(out, len, "   %s done: %s", opName(e.a), resultName((int16_t)e.b));
+		break;
+	case ESP8266_TRACE_TIMEOUT:
+		snprintf(out, len, "!! %s timed out, %u bytes received", opName(e.a), e.b);
+		break;
+	case ESP8266_TRACE_URC: {
+		unsigned type = e.a & 0xf;
+		const char * name = type < sizeof(eventNames) / sizeof(eventNames[0]) ? eventNames[type] : "?";
+		if (link == 0xf)
+			snprintf(out, len, "<- %s", name);
+		else if (type == ESP8266_EVENT_IPD)
+			snprintf(out, len, "<- %s link %u, %u bytes", name, link, e.b);
+		else
+			snprintf(out, len, "<- %s link %u", name, link);
+		break;
+	}
+	case ESP8266_TRACE_OVERFLOW:
+		snprintf(out, len, "!! serial overflow");
+		break;
+	case ESP8266_TRACE_DISCARD:
+		snprintf(out, len, "!! discarded %u bytes of link %u", e.b, e.a);
+		break;
+	case ESP8266_TRACE_BAUD:
+		snprintf(out, len, "   baud rate index %u", e.a);
+		break;
+	case ESP8266_TRACE_ASSERT:
+		snprintf(out, len, "!! ASSERT failed, line %u", e.b);
+		break;
+	case ESP8266_TRACE_USER:
+		snprintf(out, len, "   user %u %u", e.a, e.b);
+		break;
+	default:
+		snprintf(out, len, "   type %u: %u %u", e.type, e.a, e.b);
+	}
+}
+
+static void decode(FILE * in)
+{
+	char line[256];
+	bool inDump = false;
+	uint32_t first = 0, prev = 0;
+	unsigned n = 0;
+
+	while (fgets(line, sizeof(line), in)) {
+		// the dump may share the log with other output
+		char * p = strchr(line, '@');
+		if (p == NULL) continue;
+		if (strncmp(p, "@trace", 6) == 0) {
+			printf("trace, %lu entries\n", strtoul(p + 6, NULL, 16));
+			printf("   time ms     +delta  what\n");
+			inDump = true;
+			n = 0;
+			continue;
+		}
+		if (!inDump) continue;
+		if (strncmp(p, "@end", 4) == 0) {
+			inDump = false;
+			printf("\n");
+			continue;
+		}
+
+		esp8266_trace_entry e;
+		char * q;
+		e.time = strtoul(p + 1, &q, 16);
+		e.type = strtoul(q, &q, 16);
+		e.a = strtoul(q, &q, 16);
+		e.b = strtoul(q, &q, 16);
+		if (n++ == 0) first = prev = e.time;
+
+		char what[80];
+		describe(e, what, sizeof(what));
+		printf("%10.3f %+10.3f  %s\n", (uint32_t)(e.time - first) / 1000.0,
+			(uint32_t)(e.time - prev) / 1000.0, what);
+		prev = e.time;
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc < 2) {
+		decode(stdin);
+		return 0;
+	}
+	for (int i = 1; i < argc; i++) {
+		FILE * f = fopen(argv[i], "r");
+		if (f == NULL) {
+			perror(argv[i]);
+			return 1;
+		}
+		decode(f);
+		fclose(f);
+	}
+	return 0;
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+fast_join_test.cpp
+
+connectAPFast() against the simulated ESP8266: the first join learns the
+AP's BSSID and later ones go to it directly; a static address is applied
+before the join, and DHCP turned back on; when the AP has been replaced,
+the stale BSSID fails, the join falls back to the plain one and learns
+the new AP; a failed join forgets the BSSID.
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+typedef std::vector<std::string> commands;
+
+// join from scratch and return the commands it took
+static commands join(const char * pwd, int16_t & result)
+{
+	CHECK(esp8266.disconnectAP() >= 0);
+	settle(700);
+	sim.commandLog.clear();
+	result = esp8266.connectAPFast(sim.ssid, pwd);
+	return sim.commandLog;
+}
+
+static bool zero(const uint8_t * b, uint8_t n)
+{
+	while (n-- > 0) if (*b++) return false;
+	return true;
+}
+
+int main()
+{
+	Serial.quiet = true;
+	sim.begin(115200);
+	sim.logCommands = true;
+	CHECK(esp8266.begin(115200) >= 0);
+	esp8266_join_cache & cache = esp8266.joinCache();
+	CHECK(zero(cache.bssid, 6));
+	
+	// nothing known: plain join, then ask which AP took us
+	int16_t r;
+	commands c = join(sim.password, r);
+	CHECK(r > 0 && esp8266.wifiConnected());
+	CHECK(c == commands({ "AT+CWJAP_CUR=\"sim\",\"secret\"", "AT+CWJAP_CUR?" }));
+	CHECK(cache.bssid[0] == 0 && cache.bssid[1] == 0xaa && cache.bssid[5] == 0xee && cache.channel == 6);
+	
+	// known: straight to that AP
+	c = join(sim.password, r);
+	CHECK(r > 0);
+	CHECK(c == commands({ "AT+CWJAP_CUR=\"sim\",\"secret\",\"00:aa:bb:cc:dd:ee\"" }));
+	
+	// static address first, then no DHCP
+	esp8266.setStaticIP(IPAddress(192,168,0,50), IPAddress(192,168,0,1), IPAddress(255,255,255,0));
+	c = join(sim.password, r);
+	CHECK(r > 0 && sim.staticIp == "192.168.0.50");
+	CHECK(c.size() == 2 && c[0].compare(0, 14, "AT+CIPSTA_CUR=") == 0);
+	CHECK(esp8266.joinMillis() < 1100);
+	// and back to DHCP
+	esp8266.setStaticIP(IPAddress(0,0,0,0), IPAddress(0,0,0,0), IPAddress(0,0,0,0));
+	c = join(sim.password, r);
+	CHECK(r > 0 && sim.staticIp.empty());
+	CHECK(c.size() == 2 && c[0] == "AT+CWDHCP_CUR=1,1");
+	
+	// AP replaced: stale BSSID fails, plain join finds the new one
+	sim.bssid = "02:11:22:33:44:55";
+	sim.channel = 11;
+	c = join(sim.password, r);
+	CHECK(r > 0 && esp8266.wifiConnected());
+	CHECK(c == commands({
+		"AT+CWJAP_CUR=\"sim\",\"secret\",\"00:aa:bb:cc:dd:ee\"",
+		"AT+CWJAP_CUR=\"sim\",\"secret\"",
+		"AT+CWJAP_CUR?" }));
+	CHECK(cache.bssid[0] == 0x02 && cache.bssid[5] == 0x55 && cache.channel == 11);
+	c = join(sim.password, r);
+	CHECK(r > 0 && c.size() == 1 && c[0].find("02:11:22:33:44:55") != std::string::npos);
+	
+	// wrong password: both tries fail, BSSID forgotten
+	c = join("wrong", r);
+	CHECK(r < 0 && !esp8266.wifiConnected());
+	CHECK(c.size() == 2 && zero(cache.bssid, 6));
+	
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,34 @@
+/******************************************************************************
+host_clock.cpp - virtual time for host builds
+
+Time only moves when the code asks for it (or the simulator moves it), so runs
+are repeatable and busy-wait loops in the library still make progress.
+******************************************************************************/
+
+#include <Arduino.h>
+#include "host_clock.h"
+
+HardwareSerial Serial;
+
+static unsigned long long nowMicros;
+
+unsigned long long hostMicros() { return nowMicros; }
+void hostAdvance(unsigned long long us) { nowMicros += us; }
+
+// every look at the clock costs a little cpu time
+unsigned long micros() { return (unsigned long)(nowMicros += HOST_CALL_COST_US); }
+unsigned long millis() { nowMicros += HOST_CALL_COST_US; return (unsigned long)(nowMicros / 1000); }
+void delay(unsigned long ms) { nowMicros += ms * 1000ULL; }
+void delayMicroseconds(unsigned int us) { nowMicros += us; }
+
+static unsigned long rnd = 12345;
+long random(long howbig)
+{
+	if (howbig <= 0) return 0;
+	rnd = rnd * 1103515245 + 12345;
+	return (long)((rnd >> 8) % (unsigned long)howbig);
+}
+long random(long howsmall, long howbig)
+{
+	return howsmall + random(howbig - howsmall);
+}
@@ -0,0 +1,9 @@
+#ifndef __host_clock_h__
+#define __host_clock_h__
+
+#define HOST_CALL_COST_US 1
+
+unsigned long long hostMicros();
+void hostAdvance(unsigned long long us);
+
+#endif
@@ -0,0 +1,33 @@
+/******************************************************************************
+host_test.h
+
+Bits shared by the behaviour tests (*_test.cpp) that drive the library
+against the simulated ESP8266.  Each test is a program that prints OK and
+exits 0, or names the first check that failed and exits 1.
+
+	make test
+******************************************************************************/
+
+#ifndef __host_test_h__
+#define __host_test_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp8266_lib.h"
+
+#define CHECK(x) do { \
+	if (!(x)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+		exit(1); \
+	} \
+} while (0)
+
+// poll for ms of virtual time, so that what the sim has queued arrives
+static inline void settle(unsigned long ms)
+{
+	unsigned long t = millis();
+	while (millis() - t < ms) esp8266.poll();
+}
+
+#endif
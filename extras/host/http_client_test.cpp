@@ -0,0 +1,79 @@
+/******************************************************************************
+http_client_test.cpp
+
+Esp8266HttpClient against the simulated ESP8266 answering as a web server
+(PEER_HTTP): a GET with Content-Length, a chunked one on the kept-alive
+link, a POST, and a response left half read.
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "esp8266_http_client.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+static std::string body;
+static void onBody(const uint8_t * data, size_t len) { body.append((const char *)data, len); }
+
+static std::string headers;
+static void onHeader(const char * name, const char * value) { headers += std::string(name) + "=" + value + ";"; }
+
+int main()
+{
+	Serial.quiet = true;
+	sim.begin(115200);
+	CHECK(esp8266.begin(115200) >= 0);
+	sim.setPeer(Esp8266Sim::PEER_HTTP);
+	
+	Esp8266HttpClient http;
+	http.onHeader(onHeader);
+	
+	// Content-Length
+	CHECK(http.get("api.net", 80, "/a") == 200);
+	uint8_t link = http.client().link();
+	CHECK(sim.peerData[link] == "GET /a HTTP/1.1\r\nHost: api.net\r\n\r\n");
+	CHECK(http.contentLength() == 2 && !http.chunked());
+	CHECK(headers == "Content-Length=2;");
+	CHECK(http.readBody(onBody) == 2 && body == "ok" && http.bodyDone());
+	
+	// chunked, on the same link: no CIPSTART
+	std::string data;
+	for (int i = 0; i < 3000; i++) data += 'a' + i % 26;
+	sim.httpResponse = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+	for (size_t i = 0; i < data.size(); i += 1000)
+		sim.httpResponse += "3e8;ext=1\r\n" + data.substr(i, 1000) + "\r\n";
+	sim.httpResponse += "0\r\nTrailer: x\r\n\r\n";
+	CHECK(http.get("api.net", 80, "/big") == 200);
+	CHECK(http.client().link() == link);
+	CHECK(sim.lastCommand.find("CIPSTART") == std::string::npos);
+	CHECK(http.chunked() && http.contentLength() == -1);
+	body.clear();
+	CHECK(http.readBody(onBody) == 3000 && body == data);
+	
+	// POST with a body; 100 Continue is skipped
+	sim.httpResponse = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+	CHECK(http.beginRequest("POST", "api.net", 8080, "/p") == 1);
+	http.sendHeader("Content-Type", "text/plain");
+	http.endRequest(5);
+	http.print("hello");
+	link = http.client().link();
+	CHECK(http.responseStatus() == 201 && http.bodyDone());
+	CHECK(sim.peerData[link].find("Host: api.net:8080\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nhello") != std::string::npos);
+	
+	// half read: the link is no good for another request and is closed
+	sim.httpResponse = "HTTP/1.1 200 OK\r\nContent-Length: 1000\r\n\r\n" + std::string(1000, 'x');
+	CHECK(http.get("api.net", 80, "/x") == 200);
+	link = http.client().link();
+	uint8_t buf[10];
+	CHECK(http.read(buf, sizeof(buf)) == sizeof(buf));
+	http.stop();
+	CHECK(!sim.linkOpen[link]);
+	
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,125 @@
+/******************************************************************************
+http_server_test.cpp
+
+Esp8266HttpServer against the simulated ESP8266, requests coming from the
+simulated remote: a static page, a handler taking the query string from a
+request split over two packets, a wildcard route, a POST body, no route
+and wrong method, and a client asking for close.
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "esp8266_http_server.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+static std::string posted;
+
+static void led(Esp8266HttpServer & http)
+{
+	http.send(200, ESP8266_HTTP_TEXT, http.query());
+}
+
+static void api(Esp8266HttpServer & http)
+{
+	http.send(200, ESP8266_HTTP_JSON, "{}");
+}
+
+static void post(Esp8266HttpServer & http)
+{
+	uint8_t buf[3];
+	int n;
+	while ((n = http.read(buf, sizeof(buf))) > 0) posted.append((char *)buf, n);
+	http.send(201, ESP8266_HTTP_TEXT, "");
+}
+
+const char indexPath[] PROGMEM = "/";
+const char indexPage[] PROGMEM = "<html>hi</html>";
+const char ledPath[] PROGMEM = "/led";
+const char apiPath[] PROGMEM = "/api/*";
+const char postPath[] PROGMEM = "/post";
+const esp8266_http_route routes[] PROGMEM = {
+	{ ESP8266_HTTP_GET, indexPath, NULL, ESP8266_HTTP_HTML, (const uint8_t *)indexPage, sizeof(indexPage) - 1 },
+	{ ESP8266_HTTP_ANY, ledPath, led },
+	{ ESP8266_HTTP_GET, apiPath, api },
+	{ ESP8266_HTTP_POST, postPath, post },
+};
+static Esp8266HttpServer http(80, routes, ESP8266_HTTP_ROUTES(routes));
+
+// what loop() would do for a while
+static void serve()
+{
+	unsigned long t = millis();
+	while (millis() - t < 30) {
+		esp8266.poll();
+		http.handle();
+	}
+}
+
+// what remote got since last time
+static std::string response(uint8_t link)
+{
+	std::string r = sim.peerData[link];
+	sim.peerData[link].clear();
+	return r;
+}
+
+int main()
+{
+	Serial.quiet = true;
+	sim.begin(115200);
+	CHECK(esp8266.begin(115200) >= 0);
+	CHECK(http.begin());
+	
+	sim.remoteConnect(0);
+	serve();
+	
+	// static page: headers and body in one CIPSEND
+	unsigned long sends = sim.sendCommands;
+	sim.remoteSend(0, "GET / HTTP/1.1\r\nHost: x\r\n\r\n");
+	serve();
+	CHECK(sim.sendCommands - sends == 1);
+	CHECK(response(0) == "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 15\r\n\r\n<html>hi</html>");
+	CHECK(esp8266.tcpConnected(0));
+	
+	// kept alive; request line split over packets; handler sees the query
+	sim.remoteSend(0, "GET /le");
+	serve();
+	sim.remoteSend(0, "d?on=1 HTTP/1.1\r\nX: y\r\n\r\n");
+	serve();
+	CHECK(response(0) == "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 4\r\n\r\non=1");
+	
+	// wildcard matches anything below, not the prefix itself
+	sim.remoteSend(0, "GET /api/x/y?q HTTP/1.1\r\n\r\n");
+	serve();
+	CHECK(response(0).find("application/json\r\nContent-Length: 2\r\n\r\n{}") != std::string::npos);
+	sim.remoteSend(0, "GET /api HTTP/1.1\r\n\r\n");
+	serve();
+	CHECK(response(0).find("404 Not Found") != std::string::npos);
+	
+	// body read by the handler
+	sim.remoteSend(0, "POST /post HTTP/1.1\r\ncontent-LENGTH:  10\r\n\r\n0123456789");
+	serve();
+	CHECK(posted == "0123456789");
+	CHECK(response(0) == "HTTP/1.1 201 Created\r\nContent-Type: text/plain\r\nContent-Length: 0\r\n\r\n");
+	
+	// path known, method not
+	sim.remoteSend(0, "DELETE / HTTP/1.1\r\n\r\n");
+	serve();
+	CHECK(response(0).find("405 Method") != std::string::npos);
+	CHECK(esp8266.tcpConnected(0));
+	
+	// client asks for close: HEAD, so headers only, then the link goes
+	sim.remoteSend(0, "HEAD / HTTP/1.1\r\nConnection: close\r\n\r\n");
+	serve();
+	CHECK(response(0) == "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 15\r\nConnection: close\r\n\r\n");
+	CHECK(!esp8266.tcpConnected(0) && !sim.linkOpen[0]);
+	
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+link_rx_test.cpp
+
+Per link receive rings against the simulated ESP8266: payload that fits
+survives AT commands, and an +IPD frame cut short by the module does not
+hang us.
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+int main()
+{
+	Serial.quiet = true;
+	sim.begin(115200);
+	CHECK(esp8266.begin(115200) >= 0);
+	CHECK(esp8266.tcpConnect(3, "host", 80, 0) >= 0);
+	CHECK(esp8266.tcpConnect(4, "host", 80, 0) >= 0);
+	
+	// payload on two links, then a command: nothing is lost
+	sim.remoteSend(3, "three");
+	sim.remoteSend(4, "four");
+	IPAddress ip;
+	CHECK(esp8266.getLocalIP(ip) >= 0);
+	char buf[16];
+	CHECK(esp8266.tcpRead(4, (uint8_t *)buf, sizeof(buf)) == 4 && memcmp(buf, "four", 4) == 0);
+	CHECK(esp8266.tcpRead(3, (uint8_t *)buf, sizeof(buf)) == 5 && memcmp(buf, "three", 5) == 0);
+	
+	// frame announces more than comes: what came is kept, the rest given
+	// up after a quiet line, and commands go on
+	unsigned long discarded = esp8266.getStats().discardedBytes;
+	sim.cutFrame(3, "abc", 100);
+	settle(20);
+	CHECK(esp8266.tcpAvailable(3) == 3);
+	CHECK(esp8266.getStats().discardedBytes - discarded == 97);
+	CHECK(esp8266.getLocalIP(ip) >= 0);
+	CHECK(esp8266.tcpRead(3, (uint8_t *)buf, sizeof(buf)) == 3 && memcmp(buf, "abc", 3) == 0);
+	
+	// same, with the ring full and a command waiting on the rest
+	std::string full(ESP8266_LINK_RX_BUFFER_LEN, 'f');
+	sim.remoteSend(4, full.c_str());
+	sim.cutFrame(4, "x", 10);
+	CHECK(esp8266.getLocalIP(ip) >= 0);
+	CHECK(esp8266.tcpAvailable(4) == ESP8266_LINK_RX_BUFFER_LEN);
+	
+	printf("OK\n");
+	return 0;
+}
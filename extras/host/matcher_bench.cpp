@@ -0,0 +1,149 @@
+/******************************************************************************
+matcher_bench.cpp
+
+Host-side benchmark of response keyword matching.  Feeds recorded ESP8266
+responses through
+
+  - the old path: append byte to rx buffer, then strstr() the whole buffer
+    for every async keyword plus the pass/fail tokens (what
+    readForResponses()/checkAsyncMsg() used to do), and
+  - the new path: Esp8266Matcher::feed() once per byte
+
+and reports ns (and TSC cycles on x86) per byte.
+
+Build and run (from this directory):
+
+	make matcher_bench
+	./matcher_bench
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "esp8266_matcher.h"
+
+static const char OK[] = "OK\r\n";
+static const char ERROR[] = "ERROR\r\n";
+static const char IPD[] = "+IPD,";
+static const char CONNECT_0[] = "0,CONNECT\r\n";
+static const char CONNECT[] = ",CONNECT\r\n";
+static const char CLOSED_0[] = "0,CLOSED\r\n";
+
+struct recording {
+	const char * name;
+	const char * data;
+	const char * pass;
+	const char * fail;
+};
+
+static const recording recordings[] = {
+	{ "AT", "\r\nOK\r\n", OK, NULL },
+	{ "AT+GMR",
+		"AT version:1.0.0.0(Apr 16 2016 13:02:45)\r\n"
+		"SDK version:1.5.3(aec24ac9)\r\n"
+		"compile time:Apr 18 2016 14:20:15\r\n"
+		"OK\r\n", OK, NULL },
+	{ "AT+CIFSR",
+		"+CIFSR:STAIP,\"192.168.0.114\"\r\n"
+		"+CIFSR:STAMAC,\"18:fe:34:9d:b7:d9\"\r\n"
+		"\r\nOK\r\n", OK, NULL },
+	{ "AT+CWJAP?",
+		"+CWJAP:\"WiFiSSID\",\"00:aa:bb:cc:dd:ee\",6,-45\r\n\r\nOK\r\n", OK, NULL },
+	{ "AT+CWJAP_CUR=",
+		"WIFI DISCONNECT\r\nWIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n", OK, "FAIL" },
+	{ "AT+CIPSTART=",
+		"0,CONNECT\r\n\r\nOK\r\n", OK, ERROR },
+	{ "AT+PING=",
+		"+12\r\n\r\nOK\r\n", OK, ERROR },
+};
+
+#define ROUNDS 20000
+
+static char rxBuffer[128];
+static unsigned int bufferHead;
+static const char * volatile found;	// keeps the compiler from dropping strstr()
+
+// old path: strstr over the whole buffer after every byte
+static int oldPath(const recording & r)
+{
+	bufferHead = 0;
+	for (const char * p = r.data; *p; p++) {
+		rxBuffer[bufferHead++] = *p;
+		rxBuffer[bufferHead] = 0;
+		// checkAsyncMsg()
+		if ((found = strstr(rxBuffer, CONNECT_0)) == NULL)
+			found = strstr(rxBuffer, CONNECT);
+		found = strstr(rxBuffer, CLOSED_0);
+		found = strstr(rxBuffer, IPD);
+		if (r.pass && strstr(rxBuffer, r.pass)) return 1;
+		if (r.fail && strstr(rxBuffer, r.fail)) return -1;
+	}
+	return 0;
+}
+
+// new path: one matcher step per byte
+static int newPath(Esp8266Matcher & m, const recording & r)
+{
+	bufferHead = 0;
+	m.set(0, r.pass);
+	m.set(1, r.fail);
+	m.restart();
+	for (const char * p = r.data; *p; p++) {
+		rxBuffer[bufferHead++] = *p;
+		rxBuffer[bufferHead] = 0;
+		uint16_t match = m.feed(*p);
+		if (match & ESP8266_MATCH(0)) return 1;
+		if (match & ESP8266_MATCH(1)) return -1;
+	}
+	return 0;
+}
+
+template <class F>
+static void measure(const char * label, size_t bytes, F fn)
+{
+	volatile int sink = 0;
+	auto t0 = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+	unsigned long long c0 = __rdtsc();
+#endif
+	for (int i = 0; i < ROUNDS; i++)
+		sink += fn();
+#ifdef HAVE_TSC
+	unsigned long long c1 = __rdtsc();
+#endif
+	auto t1 = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+	double total = (double)bytes * ROUNDS;
+	printf("  %-4s %8.2f ns/byte", label, ns / total);
+#ifdef HAVE_TSC
+	printf("  %8.2f cycles/byte", (c1 - c0) / total);
+#endif
+	printf("\n");
+	(void)sink;
+}
+
+int main()
+{
+	Esp8266Matcher m;
+	m.set(2, CONNECT);
+	m.set(3, CLOSED_0);
+	m.set(4, IPD);
+
+	for (const recording & r : recordings) {
+		size_t bytes = strlen(r.data);
+		if (oldPath(r) != newPath(m, r)) {
+			printf("MISMATCH on %s\n", r.name);
+			return 1;
+		}
+		printf("%s (%zu bytes)\n", r.name, bytes);
+		measure("old", bytes, [&]() { return oldPath(r); });
+		measure("new", bytes, [&]() { return newPath(m, r); });
+	}
+	return 0;
+}
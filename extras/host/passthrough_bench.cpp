@@ -0,0 +1,108 @@
+/******************************************************************************
+passthrough_bench.cpp
+
+Throughput of framed transfers (CIPSEND per write, +IPD per segment) versus
+transparent transmission (tcpPassthroughStart()) over the simulated ESP8266
+(esp8266_sim.h) on virtual time.  Reports goodput in bytes per second of
+simulated time and the number of AT commands used.
+
+Build and run (from this directory):
+
+	make passthrough_bench
+	./passthrough_bench
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "esp8266_lib.h"
+
+#define BAUD 115200
+#define TOTAL 32768
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+static uint8_t payload[2048];
+
+static void report(const char * label, unsigned long long t0, unsigned long cmds0, size_t bytes)
+{
+	double secs = (hostMicros() - t0) / 1e6;
+	printf("  %-28s %8.0f B/s  %5lu AT commands\n", label, bytes / secs, sim.commands - cmds0);
+}
+
+static bool upload(const char * label, bool passthrough, size_t writeSize)
+{
+	unsigned long cmds0 = sim.commands;
+	unsigned long long t0 = hostMicros();
+	if (passthrough) {
+		if (esp8266.tcpPassthroughStart("host", 80) < 0) return false;
+	} else {
+		if (esp8266.tcpConnect(0, "host", 80, 0) < 0) return false;
+	}
+	sim.peerData[0].clear();
+	
+	unsigned long long tx0 = hostMicros();
+	for (size_t n = 0; n < TOTAL; n += writeSize) {
+		if (esp8266.tcpWrite(0, payload, writeSize) != (int16_t)writeSize) return false;
+	}
+	// wait for last passthrough packet to leave
+	while (sim.peerData[0].size() < TOTAL) esp8266.poll();
+	report(label, tx0, cmds0, TOTAL);
+	
+	if (esp8266.tcpClose(0) < 0) return false;
+	(void)t0;
+	return sim.peerData[0].size() == TOTAL;
+}
+
+static bool download(const char * label, bool passthrough)
+{
+	unsigned long cmds0 = sim.commands;
+	if (passthrough) {
+		if (esp8266.tcpPassthroughStart("host", 80) < 0) return false;
+	} else {
+		if (esp8266.tcpConnect(0, "host", 80, 0) < 0) return false;
+	}
+	
+	unsigned long long t0 = hostMicros();
+	for (size_t n = 0; n < TOTAL; n += 1460)
+		sim.remoteSend(0, payload, min((size_t)1460, (size_t)TOTAL - n));
+	
+	size_t got = 0;
+	uint8_t buf[64];
+	while (got < TOTAL) {
+		int16_t n = esp8266.tcpRead(0, buf, sizeof(buf));
+		if (n < 0) return false;
+		got += n;
+	}
+	report(label, t0, cmds0, TOTAL);
+	
+	return esp8266.tcpClose(0) >= 0;
+}
+
+int main()
+{
+	Serial.quiet = true;
+	for (size_t i = 0; i < sizeof(payload); i++) payload[i] = 'a' + i % 26;
+	
+	sim.begin(BAUD);
+	if (esp8266.begin(BAUD) < 0) {
+		printf("begin failed\n");
+		return 1;
+	}
+	
+	printf("upload %u bytes at %u baud\n", TOTAL, BAUD);
+	bool ok = upload("framed, 64 byte writes", false, 64)
+		&& upload("framed, 2048 byte writes", false, 2048)
+		&& upload("passthrough, 64 byte writes", true, 64);
+	
+	printf("download %u bytes at %u baud\n", TOTAL, BAUD);
+	ok = ok && download("framed (+IPD)", false)
+		&& download("passthrough", true);
+	
+	printf("dropped %lu bytes\n", sim.droppedBytes);
+	if (!ok) printf("FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+/******************************************************************************
+pool_test.cpp
+
+Client link pool against the simulated ESP8266: without setPooling()
+stop() closes; with it a link is taken up again by the next connect() to
+the same host and port, parked links that go stale are closed rather
+than reused, and the one parked longest makes way when links run out.
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "esp8266_client.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+static bool sent(const char * prefix)
+{
+	return sim.lastCommand.compare(0, strlen(prefix), prefix) == 0;
+}
+
+int main()
+{
+	Serial.quiet = true;
+	sim.begin(115200);
+	CHECK(esp8266.begin(115200) >= 0);
+	
+	// off by default: stop() closes
+	Esp8266Client plain;
+	CHECK(plain.connect("api.net", 80) == 1);
+	uint8_t link = plain.link();
+	plain.stop();
+	CHECK(!sim.linkOpen[link] && sent("AT+CIPCLOSE"));
+	
+	// parked and taken up again without a command
+	Esp8266Client a;
+	a.setPooling(true);
+	CHECK(a.connect("api.net", 80) == 1);
+	link = a.link();
+	a.print("one");
+	a.stop();
+	CHECK(sim.linkOpen[link]);
+	unsigned long commands = sim.commands;
+	CHECK(a.connect("API.net", 80) == 1);
+	CHECK(a.link() == link && sim.commands == commands);
+	a.print("two");
+	a.stop();
+	CHECK(sim.peerData[link] == "onetwo");
+	
+	// other port: a link of its own
+	Esp8266Client b;
+	b.setPooling(true);
+	CHECK(b.connect("api.net", 81) == 1);
+	CHECK(b.link() != link && sent("AT+CIPSTART"));
+	b.stop();
+	
+	// closed by remote while parked: connected anew
+	sim.remoteClose(link);
+	settle(5);
+	CHECK(a.connect("api.net", 80) == 1);
+	CHECK(sent("AT+CIPSTART"));
+	link = a.link();
+	a.stop();
+	
+	// data came in while parked: belongs to no one, link is closed
+	sim.remoteSend(link, "stray");
+	settle(5);
+	CHECK(a.connect("api.net", 80) == 1);
+	CHECK(a.available() == 0 && sent("AT+CIPSTART"));
+	a.stop();
+	
+	// idle too long: closed on the next connect, not reused
+	delay(ESP8266_POOL_IDLE_TIMEOUT);
+	CHECK(a.connect("api.net", 80) == 1);
+	CHECK(sent("AT+CIPSTART"));
+	a.stop();
+	esp8266.tcpPoolClose();
+	for (uint8_t i = 0; i < ESP8266_MAX_SOCK_NUM; i++) CHECK(!sim.linkOpen[i]);
+	
+	// links run out: the one parked longest is closed for a new host
+	Esp8266Client cs[ESP8266_MAX_SOCK_NUM];
+	char host[8];
+	for (uint8_t i = 0; i < ESP8266_MAX_SOCK_NUM; i++) {
+		snprintf(host, sizeof(host), "h%u", i);
+		cs[i].setPooling(true);
+		CHECK(cs[i].connect(host, 80) == 1);
+	}
+	uint8_t oldest = cs[0].link();
+	for (uint8_t i = 0; i < ESP8266_MAX_SOCK_NUM; i++) {
+		cs[i].stop();
+		delay(1);
+	}
+	CHECK(esp8266.getFreeLink() == ESP8266_SOCK_NOT_AVAIL);
+	Esp8266Client c;
+	CHECK(c.connect("new.net", 80) == 1);
+	CHECK(c.link() == oldest);
+	// h1 is still parked
+	commands = sim.commands;
+	c.setPooling(true);
+	c.stop();
+	CHECK(c.connect("h1", 80) == 1);
+	CHECK(sim.commands == commands);
+	
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+server_test.cpp
+
+Esp8266Server against the simulated ESP8266: clients from accept() and
+available() answered the way Arduino server sketches do, dropping the
+client without flush() or stop(), and a write() to all of them.
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "esp8266_server.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+static Esp8266Server server(80);
+
+int main()
+{
+	Serial.quiet = true;
+	sim.begin(115200);
+	CHECK(esp8266.begin(115200) >= 0);
+	server.begin();
+	
+	sim.remoteConnect(0);
+	sim.remoteConnect(1);
+	settle(20);
+	
+	// accept() hands out each new connection once, in order
+	{
+		Esp8266Client c = server.accept();
+		CHECK(c && c.link() == 0);
+		c.print("welcome");
+	}
+	CHECK(sim.peerData[0] == "welcome");
+	CHECK(server.accept().link() == 1);
+	CHECK(!server.accept());
+	
+	// available() only returns clients with something to read
+	CHECK(!server.available());
+	sim.remoteSend(1, "ping");
+	settle(20);
+	{
+		Esp8266Client c = server.available();
+		CHECK(c.link() == 1 && c.available() == 4);
+		char buf[8];
+		CHECK(c.read((uint8_t *)buf, sizeof(buf)) == 4 && memcmp(buf, "ping", 4) == 0);
+		c.print("pong");
+		c.println(42);
+	}
+	CHECK(sim.peerData[1] == "pong42\r\n");
+	CHECK(esp8266.tcpConnected(0) && esp8266.tcpConnected(1));
+	
+	// write() goes to everyone, and counts past 32K
+	static uint8_t big[40000];
+	memset(big, 'z', sizeof(big));
+	sim.peerData[0].clear();
+	sim.peerData[1].clear();
+	CHECK(server.write(big, sizeof(big)) == sizeof(big));
+	CHECK(sim.peerData[0].size() == sizeof(big) && sim.peerData[1].size() == sizeof(big));
+	
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,116 @@
+/******************************************************************************
+supervisor_test.cpp
+
+Esp8266Supervisor against the simulated ESP8266: a watched link closed by
+remote is connected again, with the wait between failed attempts
+doubling, but not before what it received last has been read; and an
+attempt in flight when its link is unwatched does not keep a command
+slot.
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string.h>
+#include <string>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "esp8266_supervisor.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+static Esp8266Supervisor supervisor;
+
+#define MAX_CONNECTS 8
+static unsigned long connects[MAX_CONNECTS];	// millis() of each CIPSTART
+static uint8_t connectCount;
+
+// loop() that leaves everything to the supervisor
+static void serve(unsigned long ms)
+{
+	unsigned long t = millis();
+	while (millis() - t < ms) {
+		supervisor.handle();
+		if (sim.lastCommand.find("AT+CIPSTART") == 0) {
+			if (connectCount < MAX_CONNECTS) connects[connectCount] = millis();
+			connectCount++;
+			sim.lastCommand.clear();
+		}
+	}
+}
+
+static void serveUntilUp(unsigned long max)
+{
+	unsigned long t = millis();
+	while (!supervisor.up() && millis() - t < max) serve(1);
+	serve(10);	// stats follow on the next handle()
+}
+
+int main()
+{
+	Serial.quiet = true;
+	sim.begin(115200);
+	CHECK(esp8266.begin(115200) >= 0);
+	
+	supervisor.wifi(sim.ssid, sim.password);
+	CHECK(supervisor.watch(0, "example.com", 80));
+	serveUntilUp(10000);
+	CHECK(supervisor.up() && esp8266.wifiConnected() && esp8266.tcpConnected(0));
+	CHECK(supervisor.getStats().wifiJoins == 1 && supervisor.getStats().linkConnects == 1);
+	
+	// remote closes, and connecting fails for a while
+	sim.script("AT+CIPSTART", "\r\nERROR\r\n");
+	connectCount = 0;
+	unsigned long closed = millis();
+	sim.remoteClose(0);
+	serve(20000);
+	CHECK(!supervisor.up());
+	CHECK(connectCount >= 5 && connectCount <= MAX_CONNECTS);
+	// first try within BACKOFF_MIN, then each wait twice the one before,
+	// less up to half of it
+	CHECK(connects[0] - closed <= ESP8266_BACKOFF_MIN);
+	unsigned long b = ESP8266_BACKOFF_MIN;
+	for (uint8_t i = 1; i < 5; i++, b *= 2) {
+		unsigned long wait = connects[i] - connects[i - 1];
+		CHECK(wait >= b / 2 && wait <= b + 50);
+	}
+	
+	// remote takes connections again
+	sim.clearScripts();
+	serveUntilUp(ESP8266_BACKOFF_MAX + 1000);
+	CHECK(supervisor.up() && esp8266.tcpConnected(0));
+	const esp8266_supervisor_stats & s = supervisor.getStats();
+	CHECK(s.linkDrops == 1 && s.linkConnects == 2 && s.failures == connectCount - 1);
+	CHECK(s.lastDowntime >= 20000);
+	
+	// closed with the last response unread: not connected again, which
+	// would lose it, until the sketch has read it
+	sim.remoteSend(0, "bye");
+	sim.remoteClose(0);
+	connectCount = 0;
+	serve(ESP8266_BACKOFF_MIN * 3);
+	CHECK(connectCount == 0 && !supervisor.up());
+	uint8_t buf[8];
+	CHECK(esp8266.tcpRead(0, buf, sizeof(buf)) == 3 && memcmp(buf, "bye", 3) == 0);
+	serveUntilUp(ESP8266_BACKOFF_MIN + 1000);
+	CHECK(connectCount == 1 && supervisor.up());
+	
+	// unwatched with its connect in flight, more often than the queue is
+	// long: the supervisor still collects each, so commands keep working
+	for (uint8_t i = 0; i < ESP8266_CMD_QUEUE_LEN + 1; i++) {
+		CHECK(supervisor.watch(1, "example.com", 81));
+		connectCount = 0;
+		while (connectCount == 0) serve(1);
+		supervisor.unwatch(1);
+		serve(100);
+		CHECK(esp8266.tcpConnected(1));
+		CHECK(esp8266.tcpClose(1) >= 0);
+	}
+	IPAddress ip;
+	CHECK(esp8266.getLocalIP(ip) >= 0);
+	CHECK(supervisor.up() && !esp8266.tcpConnected(1));
+	
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,75 @@
+/******************************************************************************
+udp_test.cpp
+
+Esp8266UDP against the simulated ESP8266: a listening socket takes
+datagrams from two senders and answers one, a send-only socket finds its
+destination by name.
+******************************************************************************/
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "host_clock.h"
+#include "esp8266_sim.h"
+#include "esp8266_udp.h"
+#include "host_test.h"
+
+static Esp8266Sim sim;
+Esp8266 esp8266(&sim, &esp8266SimHooks);
+
+int main()
+{
+	sim.begin(115200);
+	CHECK(esp8266.begin(115200) >= 0);
+	
+	Esp8266UDP udp;
+	CHECK(udp.begin(5000) == 1);
+	uint8_t link = udp.link();
+	CHECK(sim.lastCommand == "AT+CIPSTART=" + std::to_string(link) + ",\"UDP\",\"0.0.0.0\",0,5000,2");
+	CHECK(udp.parsePacket() == 0);
+	
+	// two datagrams back to back, each parsed on its own
+	sim.remoteIP = "10.0.0.9";
+	sim.remotePort = 1234;
+	sim.remoteSend(link, "hello");
+	sim.remotePort = 1235;
+	sim.remoteSend(link, "world!");
+	settle(20);
+	
+	char buf[16];
+	CHECK(udp.parsePacket() == 5);
+	CHECK(udp.remoteIP() == IPAddress(10,0,0,9) && udp.remotePort() == 1234);
+	CHECK(udp.read(buf, 3) == 3 && memcmp(buf, "hel", 3) == 0);
+	CHECK(udp.parsePacket() == 6);	// rest of the first one is skipped
+	CHECK(udp.remotePort() == 1235);
+	CHECK(udp.read(buf, sizeof(buf)) == 6 && memcmp(buf, "world!", 6) == 0);
+	CHECK(udp.parsePacket() == 0);
+	
+	// answer the sender of the last one
+	CHECK(udp.beginPacket(udp.remoteIP(), udp.remotePort()) == 1);
+	udp.print("pong");
+	CHECK(udp.endPacket() == 1);
+	CHECK(sim.datagrams[link].size() == 1 && sim.datagrams[link][0] == "pong");
+	CHECK(sim.datagramTo[link] == "10.0.0.9:1235");
+	
+	// a datagram that does not fit is not sent at all
+	CHECK(udp.beginPacket("10.0.0.9", 1235) == 1);
+	for (int i = 0; i <= ESP8266_UDP_TX_BUFFER_LEN; i++) udp.write('x');
+	CHECK(udp.endPacket() == 0);
+	CHECK(sim.datagrams[link].size() == 1);
+	
+	// send only, by name: CIPSEND gets the address
+	Esp8266UDP tx;
+	CHECK(tx.beginPacket("time.example.com", 123) == 1);
+	tx.write((const uint8_t *)"abc", 3);
+	CHECK(tx.endPacket() == 1);
+	CHECK(sim.datagrams[tx.link()].back() == "abc");
+	CHECK(sim.datagramTo[tx.link()] == sim.dnsAddress + ":123");
+	CHECK(tx.beginPacket("host.invalid", 123) == 0);
+	
+	udp.stop();
+	tx.stop();
+	CHECK(!sim.linkOpen[link]);
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Flash and SRAM used by a sketch for each library configuration (see
+# src/esp8266_config.h), built with arduino-cli.
+#
+#	extras/size/size_report.sh [fqbn] [sketch]
+#
+# Defaults to an Uno and examples/esp8266_client_test, which uses none of
+# the optional features, so every configuration builds.  Needs arduino-cli
+# with the board's core installed.
+
+set -e
+
+cd "$(dirname "$0")/../.."
+FQBN=${1:-arduino:avr:uno}
+SKETCH=${2:-examples/esp8266_client_test}
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+# name, then flags
+CONFIGS="
+default|
+no_server|-DESP8266_ENABLE_SERVER=0
+no_udp|-DESP8266_ENABLE_UDP=0
+no_ping|-DESP8266_ENABLE_PING=0
+no_version|-DESP8266_ENABLE_VERSION=0
+no_raw_test|-DESP8266_ENABLE_RAW_TEST=0
+no_passive|-DESP8266_ENABLE_PASSIVE_RECV=0
+no_stats|-DESP8266_ENABLE_STATS=0
+no_dns_cache|-DESP8266_ENABLE_DNS_CACHE=0
+no_pool|-DESP8266_ENABLE_POOL=0
+no_fast_join|-DESP8266_ENABLE_FAST_JOIN=0
+one_link|-DESP8266_MAX_SOCK_NUM=1
+debug_0|-DESP8266_DEBUG_LEVEL=0
+debug_2|-DESP8266_DEBUG_LEVEL=2
+trace_32|-DESP8266_TRACE_LEN=32
+small_buffers|-DESP8266_LINK_RX_BUFFER_LEN=32 -DESP8266_CLIENT_TX_BUFFER_LEN=32 -DESP8266_CMD_QUEUE_LEN=1
+minimal|-DESP8266_ENABLE_SERVER=0 -DESP8266_ENABLE_UDP=0 -DESP8266_ENABLE_PING=0 -DESP8266_ENABLE_VERSION=0 -DESP8266_ENABLE_RAW_TEST=0 -DESP8266_ENABLE_PASSIVE_RECV=0 -DESP8266_ENABLE_STATS=0 -DESP8266_ENABLE_DNS_CACHE=0 -DESP8266_ENABLE_POOL=0 -DESP8266_ENABLE_FAST_JOIN=0 -DESP8266_MAX_SOCK_NUM=1 -DESP8266_DEBUG_LEVEL=0
+"
+
+printf '%-14s %8s %8s\n' config flash sram
+echo "$CONFIGS" | while IFS='|' read -r name flags; do
+	[ -n "$name" ] || continue
+	out=$(arduino-cli compile --fqbn "$FQBN" --library . --build-path "$BUILD/$name" \
+		--build-property "compiler.cpp.extra_flags=$flags" "$SKETCH" 2>&1) || {
+		printf '%-14s build failed\n' "$name"
+		continue
+	}
+	# "Sketch uses N bytes ..." / "Global variables use N bytes ..."
+	flash=$(echo "$out" | sed -n 's/^Sketch uses \([0-9]*\) bytes.*/\1/p')
+	sram=$(echo "$out" | sed -n 's/^Global variables use \([0-9]*\) bytes.*/\1/p')
+	printf '%-14s %8s %8s\n' "$name" "$flash" "$sram"
+done
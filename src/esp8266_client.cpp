@@ -7,6 +7,30 @@
 
 Esp8266Client::Esp8266Client()
 {
+	_link = ESP8266_SOCK_NOT_AVAIL;
+	_txLen = 0;
+#if ESP8266_ENABLE_POOL
+	_pooling = false;
+#endif
+	setWriteCoalescing(ESP8266_CLIENT_TX_BUFFER_LEN);
+}
+
+Esp8266Client::Esp8266Client(uint8_t link)
+{
+	_link = link;
+	_txLen = 0;
+#if ESP8266_ENABLE_POOL
+	_pooling = false;
+#endif
+	// a view handed out by our server is usually dropped without flush()
+	setWriteCoalescing(1);
+}
+
+void Esp8266Client::setWriteCoalescing(uint16_t threshold, uint16_t maxDelay)
+{
+	flush();
+	_txThreshold = constrain(threshold, 1, ESP8266_CLIENT_TX_BUFFER_LEN);
+	_txDelay = maxDelay;
 }
 
 	
@@ -23,20 +47,34 @@ int Esp8266Client::connect(const char *host, uint16_t port)
 int Esp8266Client::connect(IPAddress ip, uint16_t port, uint32_t keepAlive) 
 {
 	char ipAddress[16];
-	sprintf(ipAddress, "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
+	esp8266IpToStr(ip, ipAddress);
 	
 	return connect((const char *)ipAddress, port, keepAlive);
 }
 	
 int Esp8266Client::connect(const char* host, uint16_t port, uint32_t keepAlive) 
 {
-	// TODO: server-bound client cannot call this
-	int ret = esp8266.tcpConnect(host, port, keepAlive);
-	if(ret >= 0) 
-		// Arduino client mandates returning 1 on success
-		return 1;
-	else
-		return ret;
+	// each client holds its own link so several can be connected at once
+	if (_link != ESP8266_SOCK_NOT_AVAIL) stop();
+	
+#if ESP8266_ENABLE_POOL
+	if (_pooling) {
+		_link = esp8266.tcpReuse(host, port);
+		if (_link != ESP8266_SOCK_NOT_AVAIL) return 1;
+	}
+#endif
+	uint8_t link = esp8266.getFreeLink();
+#if ESP8266_ENABLE_POOL
+	if (link == ESP8266_SOCK_NOT_AVAIL) link = esp8266.tcpEvict();
+#endif
+	if (link == ESP8266_SOCK_NOT_AVAIL) return ESP8266_RSP_FAIL;
+	
+	int ret = esp8266.tcpConnect(link, host, port, keepAlive);
+	if (ret < 0) return ret;
+	
+	_link = link;
+	// Arduino client mandates returning 1 on success
+	return 1;
 }
 
 size_t Esp8266Client::write(uint8_t c)
@@ -44,49 +82,97 @@ size_t Esp8266Client::write(uint8_t c)
 	return write(&c, 1);
 }
 
+// Libraries on top of Client (print() and friends in particular) write in
+// small pieces; sending each as its own CIPSEND costs a full AT round trip.
+// Small writes are copied into _txBuf.  Once it would overflow, buffered
+// and new bytes go out together in one vectored write, without copying 
+// the new ones.
 size_t Esp8266Client::write(const uint8_t *buf, size_t size)
 {
-	return esp8266.tcpWrite(buf, size);
+	if (_link == ESP8266_SOCK_NOT_AVAIL || size == 0) return 0;
+	
+	flushIfStale();
+	if (_txLen + size < _txThreshold) {
+		if (_txLen == 0) _txStart = millis();
+		memcpy(_txBuf + _txLen, buf, size);
+		_txLen += size;
+		return size;
+	}
+	
+	esp8266_iovec iov[2] = { { _txBuf, _txLen, false }, { buf, size, false } };
+	int32_t ret = esp8266.tcpWritev(_link, iov, 2);
+	uint16_t buffered = _txLen;
+	_txLen = 0;
+	return ret < buffered ? 0 : ret - buffered;
+}
+
+void Esp8266Client::flushIfStale()
+{
+	if (_txLen > 0 && _txDelay > 0 && millis() - _txStart >= _txDelay)
+		flush();
 }
 
 int Esp8266Client::available()
 {
-	return esp8266.tcpAvailable();
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return 0;
+	flush();	// remote may be waiting for it before it answers
+	return esp8266.tcpAvailable(_link);
 }
 
 int Esp8266Client::read()
 {
-	return esp8266.tcpRead();
+	if (available() == 0) return -1;
+	return esp8266.tcpRead(_link);
 }
 
 int Esp8266Client::read(uint8_t *buf, size_t size)
 {
-	return esp8266.tcpRead(buf, size);
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return -1;
+	flush();
+	return esp8266.tcpRead(_link, buf, size);
 }
 
 int Esp8266Client::peek()
 {
-	return esp8266.tcpPeek();
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return -1;
+	flush();
+	return esp8266.tcpPeek(_link);
 }
 
+// when we send tcp data, we always flush sw serial and wait for
+// positive response, so only our own buffer needs to go
 void Esp8266Client::flush()
 {
-	// nothing to be done
-	// when we send tcp data, we always flush sw serial and wait for
-	// positive response
+	if (_txLen == 0 || _link == ESP8266_SOCK_NOT_AVAIL) return;
+	esp8266.tcpWrite(_link, _txBuf, _txLen);
+	_txLen = 0;
 }
 
 void Esp8266Client::stop()
 {
-	esp8266.tcpClose();
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return;
+	flush();
+#if ESP8266_ENABLE_POOL
+	// kept open for the next connect() to the same place
+	if (_pooling && esp8266.tcpPark(_link)) {
+		_link = ESP8266_SOCK_NOT_AVAIL;
+		return;
+	}
+#endif
+	// also drops unread data if remote has closed already
+	esp8266.tcpClose(_link);
+	_link = ESP8266_SOCK_NOT_AVAIL;
 }
 
 uint8_t Esp8266Client::connected()
 {
-	return esp8266.tcpConnected();
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return 0;
+	flushIfStale();
+	// Arduino clients stay "connected" while unread data is left
+	return esp8266.tcpConnected(_link) || esp8266.tcpAvailable(_link) > 0;
 }
 
 Esp8266Client::operator bool()
 {
-	return connected();
+	return _link != ESP8266_SOCK_NOT_AVAIL;
 }
@@ -5,7 +5,6 @@
 #define __esp8266_client_h__
 
 #include <Arduino.h>
-#include <SoftwareSerial.h>
 #include <IPAddress.h>
 #include "Client.h"
 
@@ -15,6 +14,7 @@ class Esp8266Client : public Client {
 	
 public:
 	Esp8266Client();
+	Esp8266Client(uint8_t link);	// wrap an already connected link, e.g. from our server; writes not buffered
 
 	virtual int connect(IPAddress ip, uint16_t port);
 	virtual int connect(const char *host, uint16_t port);
@@ -29,10 +29,43 @@ public:
 	virtual int read();
 	virtual int read(uint8_t *buf, size_t size);
 	virtual int peek();
-	virtual void flush();
+	virtual void flush();		// send buffered writes now
 	virtual void stop();
 	virtual uint8_t connected();
 	virtual operator bool();
+	
+	uint8_t link() { return _link; }
+	
+#if ESP8266_ENABLE_POOL
+	// off by default.  When on, stop() parks the link instead of closing
+	// it, and connect() takes up a parked one to the same host and port
+	// (see Esp8266::tcpPark()).  Only for protocols that keep connections
+	// open between requests, like HTTP/1.1; a parked link holds one of
+	// ESP8266's few links until it is reused, evicted or expires.
+	void setPooling(bool enable) { _pooling = enable; }
+#endif
+	
+	// writes are buffered until threshold bytes (at most 
+	// ESP8266_CLIENT_TX_BUFFER_LEN) are collected, or, if maxDelay is not 0,
+	// the oldest buffered byte is maxDelay ms old when client is next used.
+	// flush(), stop() and reading from client send buffered data too;
+	// dropping the object does not.
+	// threshold 1 sends every write right away, which is the default for
+	// a client wrapping a link (e.g. from Esp8266Server).
+	void setWriteCoalescing(uint16_t threshold, uint16_t maxDelay = 0);
+
+private:
+	void flushIfStale();
+	
+	uint8_t _link;		// ESP8266_SOCK_NOT_AVAIL when not connected
+#if ESP8266_ENABLE_POOL
+	bool _pooling;
+#endif
+	uint8_t _txBuf[ESP8266_CLIENT_TX_BUFFER_LEN];
+	uint16_t _txLen;
+	uint16_t _txThreshold;
+	uint16_t _txDelay;
+	unsigned long _txStart;		// when first byte went into _txBuf
 };
 
 #endif /* __esp8266_client_h__ */
@@ -0,0 +1,208 @@
+/******************************************************************************
+esp8266_config.h
+
+Compile time configuration.  Every setting can be changed here or, without
+touching the library, by defining it on the compiler command line, e.g.
+build_flags = -DESP8266_ENABLE_PING=0 in platformio.ini or
+--build-property compiler.cpp.extra_flags=-DESP8266_ENABLE_PING=0 with arduino-cli.
+
+Features that are turned off are left out completely: their methods are not
+declared, and the commands behind them are not compiled into the command
+engine.  extras/size/size_report.sh shows what each one costs.
+******************************************************************************/
+
+#ifndef __esp8266_config_h__
+#define __esp8266_config_h__
+
+//////////////
+// Features //
+//////////////
+
+// tcpServerStart()/tcpServerStop(), i.e. accepting connections
+#ifndef ESP8266_ENABLE_SERVER
+#define ESP8266_ENABLE_SERVER 1
+#endif
+
+// ping()/pingAsync()
+#ifndef ESP8266_ENABLE_PING
+#define ESP8266_ENABLE_PING 1
+#endif
+
+// getVersion(); parsing AT+GMR output is mostly string handling
+#ifndef ESP8266_ENABLE_VERSION
+#define ESP8266_ENABLE_VERSION 1
+#endif
+
+// UDP links and Esp8266UDP
+#ifndef ESP8266_ENABLE_UDP
+#define ESP8266_ENABLE_UDP 1
+#endif
+
+// tcpPassiveRecv(): ESP8266 holds TCP payload until we ask for it
+#ifndef ESP8266_ENABLE_PASSIVE_RECV
+#define ESP8266_ENABLE_PASSIVE_RECV 1
+#endif
+
+// getStats()/resetStats(): traffic counters and command latencies
+#ifndef ESP8266_ENABLE_STATS
+#define ESP8266_ENABLE_STATS 1
+#endif
+
+// tcpConnect() by host name resolves through a small cache, see resolve()
+#ifndef ESP8266_ENABLE_DNS_CACHE
+#define ESP8266_ENABLE_DNS_CACHE 1
+#endif
+
+// Esp8266Client::setPooling(): stop() keeps the link open and a later
+// connect() to the same host and port takes it up again, see tcpPark()
+#ifndef ESP8266_ENABLE_POOL
+#define ESP8266_ENABLE_POOL 1
+#endif
+
+// connectAPFast(): static address and the BSSID of the last join, see
+// joinCache()
+#ifndef ESP8266_ENABLE_FAST_JOIN
+#define ESP8266_ENABLE_FAST_JOIN 1
+#endif
+
+// rawTest(), for poking at the module by hand
+#ifndef ESP8266_ENABLE_RAW_TEST
+#define ESP8266_ENABLE_RAW_TEST 1
+#endif
+
+// number of links (connections) we keep state and a receive ring for;
+// 1 to 5.  ESP8266 still runs in CIPMUX=1 mode with fewer links, but only
+// link ids below this number are usable, for clients and server alike.
+#ifndef ESP8266_MAX_SOCK_NUM
+#define ESP8266_MAX_SOCK_NUM 5
+#endif
+
+/*
+  Debug level:
+	0 - nothing; no checks, no messages
+	1 - failed checks print a warning and go on (default)
+	2 - also stop in an endless loop on a failed ASSERT, to catch bugs
+	3 - also echo all traffic with ESP8266 to Serial
+  Levels 1 and up print through Serial, which the sketch has to begin().
+*/
+#ifndef ESP8266_DEBUG_LEVEL
+#define ESP8266_DEBUG_LEVEL 1
+#endif
+
+// entries (8 bytes each) of the in-RAM trace, see esp8266_trace.h; 0 is
+// off.  With it on, debug level 3 no longer echoes every received byte,
+// as that upsets the timing the trace is meant to show.
+#ifndef ESP8266_TRACE_LEN
+#define ESP8266_TRACE_LEN 0
+#endif
+
+//////////////////
+// Buffer sizes //
+//////////////////
+
+// command responses are collected here; AT+GMR needs about 110
+#ifndef ESP8266_RX_BUFFER_LEN
+#define ESP8266_RX_BUFFER_LEN 128
+#endif
+
+// per link receive ring buffer in bytes; +IPD payload is absorbed into it
+// as it arrives so that AT commands don't have to discard it.  A frame is
+// up to 1460 bytes, and the part that does not fit still goes with the next
+// command, unless tcpPassiveRecv() is on (see esp8266_lib.h).
+#ifndef ESP8266_LINK_RX_BUFFER_LEN
+#define ESP8266_LINK_RX_BUFFER_LEN 64
+#endif
+
+// number of commands that can be queued or waiting to be collected
+#ifndef ESP8266_CMD_QUEUE_LEN
+#define ESP8266_CMD_QUEUE_LEN 2
+#endif
+
+// small writes are collected in a per client buffer and sent as one CIPSEND
+// (see Esp8266Client::setWriteCoalescing())
+#ifndef ESP8266_CLIENT_TX_BUFFER_LEN
+#define ESP8266_CLIENT_TX_BUFFER_LEN 64
+#endif
+
+// Esp8266UDP assembles an outgoing datagram here, so this is the largest
+// one it can send.  Received datagrams have to fit the link's rx ring,
+// along with ESP8266_UDP_HEADER_LEN bytes (8) of length and sender.
+#ifndef ESP8266_UDP_TX_BUFFER_LEN
+#define ESP8266_UDP_TX_BUFFER_LEN 64
+#endif
+
+// Esp8266HttpClient reads response status and header lines into this;
+// longer lines are cut, which only matters for onHeader()
+#ifndef ESP8266_HTTP_LINE_LEN
+#define ESP8266_HTTP_LINE_LEN 64
+#endif
+
+// Esp8266HttpServer keeps this much of each request's query string (after
+// '?'), per link; 1 keeps none
+#ifndef ESP8266_HTTP_QUERY_LEN
+#define ESP8266_HTTP_QUERY_LEN 16
+#endif
+
+// links one Esp8266Supervisor keeps connected
+#ifndef ESP8266_SUPERVISOR_LINKS
+#define ESP8266_SUPERVISOR_LINKS 2
+#endif
+
+// Esp8266Supervisor waits this long (ms) after the first failed attempt,
+// doubling with each further one up to the max
+#ifndef ESP8266_BACKOFF_MIN
+#define ESP8266_BACKOFF_MIN 1000UL
+#endif
+#ifndef ESP8266_BACKOFF_MAX
+#define ESP8266_BACKOFF_MAX 60000UL
+#endif
+
+// host names the DNS cache remembers (12 bytes each)
+#ifndef ESP8266_DNS_CACHE_LEN
+#define ESP8266_DNS_CACHE_LEN 4
+#endif
+
+// how long (ms) a resolved address is used before asking again; AT
+// firmware does not tell us the record's TTL
+#ifndef ESP8266_DNS_TTL
+#define ESP8266_DNS_TTL 300000UL
+#endif
+
+// how long (ms) a name that did not resolve fails without asking again
+#ifndef ESP8266_DNS_FAIL_TTL
+#define ESP8266_DNS_FAIL_TTL 10000UL
+#endif
+
+// parked links idle longer than this (ms) are closed when the pool is next
+// used; servers drop idle keep-alive connections sooner or later anyway
+#ifndef ESP8266_POOL_IDLE_TIMEOUT
+#define ESP8266_POOL_IDLE_TIMEOUT 30000UL
+#endif
+
+////////////
+// Timing //
+////////////
+
+// end of a receive burst is detected once the line has been quiet for this
+// many character times at current baud rate
+#ifndef ESP8266_RX_GAP_CHARS
+#define ESP8266_RX_GAP_CHARS 2
+#endif
+
+// begin(baud, maxBaud) checks a new baud rate with this many query
+// round trips that must come back identical to the one at old rate
+#ifndef ESP8266_BAUD_VERIFY_ROUNDS
+#define ESP8266_BAUD_VERIFY_ROUNDS 4
+#endif
+
+// step down to next lower baud rate once receive errors (overflow, garbled
+// responses) outnumber successful commands by this much
+#ifndef ESP8266_BAUD_ERROR_LIMIT
+#define ESP8266_BAUD_ERROR_LIMIT 8
+#endif
+
+#if ESP8266_MAX_SOCK_NUM < 1 || ESP8266_MAX_SOCK_NUM > 5
+#error "ESP8266_MAX_SOCK_NUM must be 1 to 5"
+#endif
+
+#endif /* __esp8266_config_h__ */
@@ -1,37 +1,54 @@
 #ifndef __esp8266_debug_h__
 #define __esp8266_debug_h__
 
-#define ESP8266_DEBUG
-//#define ESP8266_DEBUG_VERBOSE
+// ESP8266_DEBUG_LEVEL is set in esp8266_config.h
+#include "esp8266_config.h"
+#include "esp8266_trace.h"
 
-#ifdef ESP8266_DEBUG
+// a failed ASSERT leaves the trace behind, ending in the assert's line
+#if ESP8266_TRACE_LEN > 0
+	#define ESP8266_TRACE_DUMP() do { \
+		ESP8266_TRACE(ESP8266_TRACE_ASSERT, 0, __LINE__); \
+		esp8266TraceDump(Serial); } while (0)
+#else
+	#define ESP8266_TRACE_DUMP()
+#endif
 
-	#define ASSERT(x) if (!(x)) { \
-		Serial.print(F("assert failed at ")); \
-		Serial.print(__func__); \
-		Serial.print(F("()@")); \
-		Serial.println(__LINE__); \
-		for(;;); }
-	#define WARN(x) if (!(x)) { \
-		Serial.print(F("warning at ")); \
+#if ESP8266_DEBUG_LEVEL >= 1
+
+	#define ESP8266_DEBUG_AT(msg) do { \
+		Serial.print(F(msg)); \
 		Serial.print(__func__); \
 		Serial.print(F("()@")); \
-		Serial.println(__LINE__);}
+		Serial.println(__LINE__); } while (0)
+	#if ESP8266_DEBUG_LEVEL >= 2
+		#define ASSERT(x) if (!(x)) { ESP8266_DEBUG_AT("assert failed at "); ESP8266_TRACE_DUMP(); for(;;); }
+	#else
+		#define ASSERT(x) if (!(x)) { ESP8266_DEBUG_AT("assert failed at "); ESP8266_TRACE_DUMP(); }
+	#endif
+	#define WARN(x) if (!(x)) ESP8266_DEBUG_AT("warning at ")
 	#define VERIFY(x, y) ASSERT(x y)
 	#define DEBUG(x)  do { x; } while (0)
-	#ifdef ESP8266_DEBUG_VERBOSE
+	#if ESP8266_DEBUG_LEVEL >= 3
 		#define DEBUG_VERBOSE(x) DEBUG(x)
 	#else
 		#define DEBUG_VERBOSE(x)
 	#endif
+	// echo of received bytes; the trace replaces it
+	#if ESP8266_TRACE_LEN == 0
+		#define DEBUG_VERBOSE_RX(x) DEBUG_VERBOSE(x)
+	#else
+		#define DEBUG_VERBOSE_RX(x)
+	#endif
 
 #else
 
 	#define ASSERT(x)
-	#define WARN(x)
+	#define WARN(x) (void)sizeof(x)		// not evaluated
 	#define VERIFY(x, y) x
 	#define DEBUG(x)
 	#define DEBUG_VERBOSE(x)
+	#define DEBUG_VERBOSE_RX(x)
 
 #endif
 
@@ -0,0 +1,276 @@
+/******************************************************************************
+******************************************************************************/
+
+#include <Arduino.h>
+#include "esp8266_http_client.h"
+#include "esp8266_lib.h"
+
+Esp8266HttpClient::Esp8266HttpClient()
+{
+	_state = HTTP_IDLE;
+	_head = false;
+	_keepAlive = false;
+	_chunked = false;
+	_length = -1;
+	_left = 0;
+	_onHeader = NULL;
+#if ESP8266_ENABLE_POOL
+	// keep-alive connections go back to the pool, see stop()
+	_client.setPooling(true);
+#endif
+}
+
+/////////////
+// Request //
+/////////////
+
+int Esp8266HttpClient::beginRequest(const char * method, const char * host, uint16_t port, const char * path)
+{
+	// previous connection, if any, goes back to the pool first; connect()
+	// takes it out again if it is to the same place
+	stop();
+	int rsp = _client.connect(host, port);
+	if (rsp != 1) return rsp;
+	
+	_state = HTTP_REQUEST;
+	_head = strcmp_P(method, PSTR("HEAD")) == 0;
+	print(method);
+	print(' ');
+	print(path);
+	print(F(" HTTP/1.1\r\nHost: "));
+	print(host);
+	if (port != 80) {
+		print(':');
+		print(port);
+	}
+	print(F("\r\n"));
+#if !ESP8266_ENABLE_POOL
+	// nothing would keep the link for the next request anyway
+	print(F("Connection: close\r\n"));
+#endif
+	return 1;
+}
+
+void Esp8266HttpClient::sendHeader(const char * name, const char * value)
+{
+	print(name);
+	print(F(": "));
+	print(value);
+	print(F("\r\n"));
+}
+
+void Esp8266HttpClient::endRequest(int32_t contentLength)
+{
+	if (contentLength >= 0) {
+		print(F("Content-Length: "));
+		print(contentLength);
+		print(F("\r\n"));
+	}
+	print(F("\r\n"));
+}
+
+size_t Esp8266HttpClient::write(uint8_t c)
+{
+	return write(&c, 1);
+}
+
+// collected by the client into CIPSENDs; goes out at latest when we start
+// reading the response
+size_t Esp8266HttpClient::write(const uint8_t *buf, size_t size)
+{
+	if (_state != HTTP_REQUEST) return 0;
+	return _client.write(buf, size);
+}
+
+int Esp8266HttpClient::get(const char * host, uint16_t port, const char * path)
+{
+	int rsp = beginRequest("GET", host, port, path);
+	if (rsp != 1) return rsp < 0 ? rsp : ESP8266_RSP_FAIL;
+	endRequest();
+	return responseStatus();
+}
+
+//////////////
+// Response //
+//////////////
+
+int Esp8266HttpClient::responseStatus()
+{
+	if (_state != HTTP_REQUEST) return ESP8266_CMD_BAD;
+	_state = HTTP_HEADERS;
+	
+	int status;
+	do {
+		// Example : HTTP/1.1 200 OK
+		int rsp;
+		while ((rsp = readLine()) == 0);
+		if (rsp < 0) return fail(rsp);
+		if (strncmp_P(_line, PSTR("HTTP/1."), 7) != 0 || _line[8] != ' ')
+			return fail(ESP8266_RSP_UNKNOWN);
+		_keepAlive = _line[7] != '0';
+		status = atoi(_line + 9);
+		
+		_length = -1;
+		_chunked = false;
+		while ((rsp = readLine()) > 0)
+			parseHeader();
+		if (rsp < 0) return fail(rsp);
+	} while (status >= 100 && status < 200);	// 100 Continue etc. come first
+	
+	if (_head || status == 204 || status == 304) {
+		_state = HTTP_DONE;
+	} else if (_chunked) {
+		_state = HTTP_CHUNK_SIZE;
+	} else if (_length >= 0) {
+		_left = _length;
+		_state = _left ? HTTP_BODY : HTTP_DONE;
+	} else {
+		// no framing: body is whatever comes until remote closes
+		_keepAlive = false;
+		_state = HTTP_BODY_CLOSE;
+	}
+	return status;
+}
+
+// "Name: value" in _line; framing headers are noted, all are shown to
+// the header handler
+void Esp8266HttpClient::parseHeader()
+{
+	char * value = strchr(_line, ':');
+	if (value == NULL) return;
+	*value++ = 0;
+	while (*value == ' ' || *value == '\t') value++;
+	char * end = value + strlen(value);
+	while (end > value && (end[-1] == ' ' || end[-1] == '\t')) *--end = 0;
+	
+	if (strcasecmp_P(_line, PSTR("Content-Length")) == 0) {
+		_length = atol(value);
+	} else if (strcasecmp_P(_line, PSTR("Transfer-Encoding")) == 0) {
+		// chunked is always the last coding
+		_chunked = end - value >= 7 && strcasecmp_P(end - 7, PSTR("chunked")) == 0;
+	} else if (strcasecmp_P(_line, PSTR("Connection")) == 0) {
+		if (strcasecmp_P(value, PSTR("close")) == 0) _keepAlive = false;
+		else if (strcasecmp_P(value, PSTR("keep-alive")) == 0) _keepAlive = true;
+	}
+	if (_onHeader) _onHeader(_line, value);
+}
+
+int Esp8266HttpClient::read(uint8_t * buf, size_t size)
+{
+	int rsp;
+	for (;;) {
+		switch (_state) {
+		case HTTP_BODY:
+		case HTTP_CHUNK_DATA:
+			if (_left == 0) {
+				// CRLF behind chunk data
+				if ((rsp = readLine()) < 0) return fail(rsp);
+				_state = HTTP_CHUNK_SIZE;
+				break;
+			}
+			rsp = readData(buf, min((uint32_t)size, _left));
+			if (rsp < 0) return fail(rsp);
+			_left -= rsp;
+			if (_left == 0 && _state == HTTP_BODY) _state = HTTP_DONE;
+			return rsp;
+		case HTTP_CHUNK_SIZE:
+			// Example : 1a2;ext=1
+			if ((rsp = readLine()) < 0) return fail(rsp);
+			_left = strtoul(_line, NULL, 16);
+			_state = _left ? HTTP_CHUNK_DATA : HTTP_TRAILER;
+			break;
+		case HTTP_TRAILER:
+			if ((rsp = readLine()) < 0) return fail(rsp);
+			if (rsp == 0) _state = HTTP_DONE;
+			break;
+		case HTTP_BODY_CLOSE:
+			rsp = readData(buf, size);
+			if (rsp == ESP8266_RSP_FAIL) {
+				_state = HTTP_DONE;		// closed; that was all of it
+				return 0;
+			}
+			if (rsp < 0) return fail(rsp);
+			return rsp;
+		case HTTP_DONE:
+			return 0;
+		case HTTP_ERROR:
+			return ESP8266_RSP_FAIL;
+		default:
+			return ESP8266_CMD_BAD;
+		}
+	}
+}
+
+int32_t Esp8266HttpClient::readBody(esp8266_http_body_handler handler)
+{
+	uint8_t buf[32];
+	int32_t total = 0;
+	int n;
+	while ((n = read(buf, sizeof(buf))) > 0) {
+		if (handler) handler(buf, n);
+		total += n;
+	}
+	return n < 0 ? n : total;
+}
+
+void Esp8266HttpClient::stop()
+{
+	if (!_client) {
+		_state = HTTP_IDLE;
+		return;
+	}
+#if ESP8266_ENABLE_POOL
+	// unread response or server asked for close: link is no good any more
+	_client.setPooling(_state == HTTP_DONE && _keepAlive);
+#endif
+	_client.stop();
+#if ESP8266_ENABLE_POOL
+	_client.setPooling(true);
+#endif
+	_state = HTTP_IDLE;
+}
+
+/////////////
+// Helpers //
+/////////////
+
+int Esp8266HttpClient::fail(int rsp)
+{
+	_state = HTTP_ERROR;
+	return rsp;
+}
+
+// ESP8266_RSP_SUCCESS once data is there; ESP8266_RSP_FAIL if remote
+// closed first
+int Esp8266HttpClient::waitForData()
+{
+	unsigned long start = millis();
+	while (_client.available() == 0) {
+		if (!_client.connected()) return ESP8266_RSP_FAIL;
+		if (millis() - start >= HTTP_RESPONSE_TIMEOUT) return ESP8266_RSP_TIMEOUT;
+	}
+	return ESP8266_RSP_SUCCESS;
+}
+
+// whatever is there, up to size; waits for the first byte
+int Esp8266HttpClient::readData(uint8_t * buf, size_t size)
+{
+	int rsp = waitForData();
+	if (rsp < 0) return rsp;
+	return _client.read(buf, size);
+}
+
+// next line into _line without CRLF, cut to fit; returns its length
+int Esp8266HttpClient::readLine()
+{
+	uint8_t n = 0;
+	for (;;) {
+		int rsp = waitForData();
+		if (rsp < 0) return rsp;
+		int c = _client.read();
+		if (c == '\n') break;
+		if (c != '\r' && n < sizeof(_line) - 1) _line[n++] = c;
+	}
+	_line[n] = 0;
+	return n;
+}
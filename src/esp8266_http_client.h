@@ -0,0 +1,105 @@
+/******************************************************************************
+esp8266_http_client.h
+
+HTTP/1.1 client on top of Esp8266Client, for responses bigger than RAM.
+The request is streamed out: beginRequest() sends request line and Host,
+sendHeader() one header each, endRequest() the blank line; a body follows
+with write()/print().  The response is parsed as it comes in:
+responseStatus() reads status line and headers (keeping only what framing
+needs, Content-Length, Transfer-Encoding and Connection; onHeader() shows
+the rest), then read() or readBody() hand out the body, chunked transfer
+encoding already taken off.  Nothing is buffered besides one header line
+(ESP8266_HTTP_LINE_LEN) and the link's rx ring.
+
+Connections are kept alive: a response read to its end leaves the link
+parked in Esp8266's pool, so the next request to the same host and port
+goes out on it without connecting (needs ESP8266_ENABLE_POOL; without it
+requests ask for Connection: close).  A response left half read, or one
+the server wants closed, closes the link.
+******************************************************************************/
+
+#ifndef __esp8266_http_client_h__
+#define __esp8266_http_client_h__
+
+#include <Arduino.h>
+
+#include "esp8266_lib.h"
+#include "esp8266_client.h"
+
+// ms to wait for the next bit of a response
+#define HTTP_RESPONSE_TIMEOUT 5000
+
+// response header, name and value (trimmed); both only valid during the call
+typedef void (*esp8266_http_header_handler)(const char * name, const char * value);
+
+// next piece of the response body
+typedef void (*esp8266_http_body_handler)(const uint8_t * data, size_t len);
+
+class Esp8266HttpClient : public Print {
+
+public:
+	Esp8266HttpClient();
+
+	// connects (or takes up a kept alive link); 1 on success, <=0 if not
+	int beginRequest(const char * method, const char * host, uint16_t port, const char * path);
+	void sendHeader(const char * name, const char * value);
+	// contentLength < 0: no body
+	void endRequest(int32_t contentLength = -1);
+
+	// body of the request
+	virtual size_t write(uint8_t);
+	virtual size_t write(const uint8_t *buf, size_t size);
+	using Print::write;
+
+	// GET in one go, up to the response headers; returns responseStatus()
+	int get(const char * host, uint16_t port, const char * path);
+
+	// status code once headers are in; <0 (esp8266_cmd_rsp) on timeout,
+	// early close or a response that is not HTTP
+	int responseStatus();
+	void onHeader(esp8266_http_header_handler handler) { _onHeader = handler; }
+	int32_t contentLength() { return _length; }		// -1 if not given
+	bool chunked() { return _chunked; }
+
+	// next body bytes, at most size; 0 once body is complete, <0 on error
+	int read(uint8_t * buf, size_t size);
+	// all of the body, piece by piece; returns its length or <0 on error
+	int32_t readBody(esp8266_http_body_handler handler);
+	bool bodyDone() { return _state == HTTP_DONE; }
+
+	// done with the connection; kept alive if the response was complete
+	void stop();
+	Esp8266Client & client() { return _client; }
+
+private:
+	enum http_state {
+		HTTP_IDLE,			// no request
+		HTTP_REQUEST,		// request going out
+		HTTP_HEADERS,		// waiting for status line and headers
+		HTTP_BODY,			// _left bytes of body to go
+		HTTP_BODY_CLOSE,	// body ends when remote closes
+		HTTP_CHUNK_SIZE,	// next line is a chunk size
+		HTTP_CHUNK_DATA,	// _left bytes of chunk to go, then CRLF
+		HTTP_TRAILER,		// trailer lines up to an empty one
+		HTTP_DONE,			// response complete
+		HTTP_ERROR
+	};
+
+	int fail(int rsp);
+	int readLine();
+	int waitForData();
+	int readData(uint8_t * buf, size_t size);
+	void parseHeader();
+
+	Esp8266Client _client;
+	uint8_t _state;			// http_state
+	bool _head;				// HEAD request: no body whatever headers say
+	bool _keepAlive;
+	bool _chunked;
+	int32_t _length;
+	uint32_t _left;
+	esp8266_http_header_handler _onHeader;
+	char _line[ESP8266_HTTP_LINE_LEN];
+};
+
+#endif /* __esp8266_http_client_h__ */
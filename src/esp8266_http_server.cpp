@@ -0,0 +1,419 @@
+/******************************************************************************
+******************************************************************************/
+
+#include <Arduino.h>
+#include "esp8266_http_server.h"
+#include "esp8266_lib.h"
+
+#if ESP8266_ENABLE_SERVER
+
+const char ESP8266_HTTP_HTML[] PROGMEM = "text/html";
+const char ESP8266_HTTP_TEXT[] PROGMEM = "text/plain";
+const char ESP8266_HTTP_JSON[] PROGMEM = "application/json";
+
+// by esp8266_http_method, from ESP8266_HTTP_GET on
+static const char methodNames[][7] PROGMEM = {
+	"GET", "HEAD", "POST", "PUT", "DELETE"
+};
+#define METHODS (sizeof(methodNames) / sizeof(methodNames[0]))
+
+// request headers we care about, lower case
+static const char headerNames[][15] PROGMEM = {
+	"content-length", "connection"
+};
+#define HEADERS (sizeof(headerNames) / sizeof(headerNames[0]))
+#define HEADER_LENGTH		0
+#define HEADER_CONNECTION	1
+
+static const char closeToken[] PROGMEM = "close";
+
+// response pieces
+static const char statusStart[] PROGMEM = "HTTP/1.1 ";
+static const char typeHeader[] PROGMEM = "\r\nContent-Type: ";
+static const char lengthHeader[] PROGMEM = "\r\nContent-Length: ";
+static const char closeHeader[] PROGMEM = "\r\nConnection: close";
+static const char headersEnd[] PROGMEM = "\r\n\r\n";
+
+static PGM_P reason(int status)
+{
+	switch (status) {
+	case 200: return PSTR("OK");
+	case 201: return PSTR("Created");
+	case 204: return PSTR("No Content");
+	case 301: return PSTR("Moved Permanently");
+	case 302: return PSTR("Found");
+	case 304: return PSTR("Not Modified");
+	case 400: return PSTR("Bad Request");
+	case 403: return PSTR("Forbidden");
+	case 404: return PSTR("Not Found");
+	case 405: return PSTR("Method Not Allowed");
+	case 500: return PSTR("Internal Server Error");
+	case 503: return PSTR("Service Unavailable");
+	}
+	return PSTR("");
+}
+
+// decimal digits of n at p, no terminating 0; returns end
+static char * putNum(char * p, uint32_t n)
+{
+	char digits[10];
+	uint8_t k = 0;
+	do {
+		digits[k++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	while (k) *p++ = digits[--k];
+	return p;
+}
+
+static void segment(esp8266_iovec & v, const void * buf, size_t len, bool progmem)
+{
+	v.buf = (const uint8_t *)buf;
+	v.len = len;
+	v.progmem = progmem;
+}
+
+Esp8266HttpServer::Esp8266HttpServer(uint16_t port, const esp8266_http_route * routes, uint8_t count)
+{
+	_port = port;
+	_routes = routes;
+	_count = min(count, (uint8_t)ESP8266_HTTP_MAX_ROUTES);
+	_current = 0;
+	_responded = false;
+	_closing = false;
+	_out = NULL;
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++)
+		reset(link);
+}
+
+bool Esp8266HttpServer::begin()
+{
+	return esp8266.tcpServerStart(_port) >= 0;
+}
+
+void Esp8266HttpServer::end()
+{
+	esp8266.tcpServerStop();
+}
+
+void Esp8266HttpServer::handle()
+{
+	// a new connection starts with a new request
+	uint8_t link;
+	while ((link = esp8266.tcpAccept()) != ESP8266_SOCK_NOT_AVAIL)
+		reset(link);
+	
+	for (link = 0; link < ESP8266_MAX_SOCK_NUM; link++) {
+		if (esp8266.tcpState(link) != ESP8266_TCP_SERVER) continue;
+		while (esp8266.tcpAvailable(link) > 0) {
+			if (feed(link, esp8266.tcpRead(link))) break;
+		}
+	}
+}
+
+////////////
+// Parser //
+////////////
+
+PGM_P Esp8266HttpServer::routePath(uint8_t i)
+{
+	PGM_P path;
+	memcpy_P(&path, &_routes[i].path, sizeof(path));
+	return path;
+}
+
+void Esp8266HttpServer::reset(uint8_t link)
+{
+	esp8266_http_conn & k = _conns[link];
+	k.state = HTTP_METHOD;
+	k.pos = 0;
+	k.match = (1 << METHODS) - 1;
+	k.method = ESP8266_HTTP_OTHER;
+	k.routes = _count < 32 ? ((uint32_t)1 << _count) - 1 : 0xffffffffUL;
+	k.star = 0;
+	k.length = 0;
+	k.close = false;
+	k.query[0] = 0;
+}
+
+// next byte of a request on link; true once it has been answered
+bool Esp8266HttpServer::feed(uint8_t link, char c)
+{
+	esp8266_http_conn & k = _conns[link];
+	uint8_t i;
+	
+	switch (k.state) {
+	case HTTP_METHOD:
+		// Example : GET /index.html?x=1 HTTP/1.1
+		if (k.pos == 0 && (c == '\r' || c == '\n')) break;	// between requests
+		if (c == ' ') {
+			for (i = 0; i < METHODS; i++) {
+				if ((k.match & (1 << i)) && pgm_read_byte(&methodNames[i][k.pos]) == 0)
+					k.method = ESP8266_HTTP_GET + i;
+			}
+			k.state = HTTP_PATH;
+			k.pos = 0;
+			break;
+		}
+		for (i = 0; i < METHODS; i++) {
+			if (k.pos >= sizeof(methodNames[0]) || pgm_read_byte(&methodNames[i][k.pos]) != c)
+				k.match &= ~(1 << i);
+		}
+		if (k.pos < 255) k.pos++;
+		break;
+	case HTTP_PATH:
+		if (c == ' ' || c == '?') {
+			endPath(k);
+			k.state = (c == '?') ? HTTP_QUERY : HTTP_VERSION;
+			k.pos = 0;
+			break;
+		}
+		matchPath(k, c);
+		if (k.pos < 255) k.pos++;
+		else k.routes = 0;
+		break;
+	case HTTP_QUERY:
+		if (c == ' ') {
+			k.state = HTTP_VERSION;
+			k.pos = 0;
+			break;
+		}
+		if (k.pos < sizeof(k.query) - 1) {
+			k.query[k.pos++] = c;
+			k.query[k.pos] = 0;
+		}
+		break;
+	case HTTP_VERSION:
+		// HTTP/1.0 is closed after each response
+		if (k.pos == 7 && c == '0') k.close = true;
+		if (c == '\n') {
+			k.state = HTTP_HEADER_NAME;
+			k.pos = 0;
+			k.match = (1 << HEADERS) - 1;
+			break;
+		}
+		if (k.pos < 255) k.pos++;
+		break;
+	case HTTP_HEADER_NAME:
+		// Example : Content-Length: 12
+		if (c == '\r') break;
+		if (c == '\n') {
+			// empty line ends the headers
+			if (k.pos == 0) {
+				dispatch(link);
+				return true;
+			}
+			k.pos = 0;
+			k.match = (1 << HEADERS) - 1;
+			break;
+		}
+		if (c == ':') {
+			for (i = 0; i < HEADERS; i++) {
+				if (k.pos >= sizeof(headerNames[0]) || pgm_read_byte(&headerNames[i][k.pos]) != 0)
+					k.match &= ~(1 << i);
+			}
+			k.state = HTTP_HEADER_VALUE;
+			k.pos = 0;
+			break;
+		}
+		for (i = 0; i < HEADERS; i++) {
+			if (k.pos >= sizeof(headerNames[0]) || pgm_read_byte(&headerNames[i][k.pos]) != tolower(c))
+				k.match &= ~(1 << i);
+		}
+		if (k.pos < 255) k.pos++;
+		break;
+	case HTTP_HEADER_VALUE:
+		if (c == '\n') {
+			if ((k.match & (1 << HEADER_CONNECTION)) && k.pos == sizeof(closeToken) - 1)
+				k.close = true;
+			k.state = HTTP_HEADER_NAME;
+			k.pos = 0;
+			k.match = (1 << HEADERS) - 1;
+			break;
+		}
+		if (c == ' ' || c == '\t' || c == '\r') break;
+		if ((k.match & (1 << HEADER_LENGTH)) && isdigit(c))
+			k.length = k.length * 10 + c - '0';
+		if (k.match & (1 << HEADER_CONNECTION)) {
+			if (k.pos < sizeof(closeToken) - 1 && tolower(c) == pgm_read_byte(&closeToken[k.pos]))
+				k.pos++;
+			else
+				k.match &= ~(1 << HEADER_CONNECTION);
+		}
+		break;
+	case HTTP_SKIP_BODY:
+		if (--k.length == 0) reset(link);
+		break;
+	}
+	return false;
+}
+
+// drop routes whose path differs at c; the first one whose '*' is reached
+// matches whatever follows, and routes behind it can't win any more
+void Esp8266HttpServer::matchPath(esp8266_http_conn & k, char c)
+{
+	for (uint8_t i = 0; i < _count; i++) {
+		uint32_t bit = (uint32_t)1 << i;
+		if (!(k.routes & bit) || k.star == i + 1) continue;
+		char r = pgm_read_byte(routePath(i) + k.pos);
+		if (r == '*') {
+			k.star = i + 1;
+			k.routes &= (bit << 1) - 1;
+			return;
+		}
+		if (r != c) k.routes &= ~bit;
+	}
+}
+
+// path complete: drop routes that are longer
+void Esp8266HttpServer::endPath(esp8266_http_conn & k)
+{
+	for (uint8_t i = 0; i < _count; i++) {
+		uint32_t bit = (uint32_t)1 << i;
+		if (!(k.routes & bit) || k.star == i + 1) continue;
+		char r = pgm_read_byte(routePath(i) + k.pos);
+		if (r != 0 && r != '*') k.routes &= ~bit;
+	}
+}
+
+// headers are in: first route that fits answers
+void Esp8266HttpServer::dispatch(uint8_t link)
+{
+	esp8266_http_conn & k = _conns[link];
+	Esp8266Client out(link);
+	out.setWriteCoalescing(ESP8266_CLIENT_TX_BUFFER_LEN);	// flushed below
+	_current = link;
+	_responded = false;
+	_closing = k.close;
+	_out = &out;
+	
+	esp8266_http_route r;
+	uint8_t i;
+	for (i = 0; i < _count; i++) {
+		if (!(k.routes & ((uint32_t)1 << i))) continue;
+		memcpy_P(&r, &_routes[i], sizeof(r));
+		if (r.method == ESP8266_HTTP_ANY || r.method == k.method) break;
+		// HEAD is GET without the body
+		if (r.method == ESP8266_HTTP_GET && k.method == ESP8266_HTTP_HEAD) break;
+	}
+	if (i < _count) {
+		if (r.handler) r.handler(*this);
+		else send_P(200, r.contentType, r.content, r.length);
+	} else {
+		// path known but not for this method?
+		sendError(k.routes ? 405 : 404);
+	}
+	if (!_responded) sendError(500);
+	out.flush();
+	_out = NULL;
+	
+	if (_closing) {
+		esp8266.tcpClose(link);
+		reset(link);
+	} else if (k.length > 0) {
+		// what is left of the body; next request follows
+		k.state = HTTP_SKIP_BODY;
+	} else {
+		reset(link);
+	}
+}
+
+//////////////
+// Handlers //
+//////////////
+
+int Esp8266HttpServer::read(uint8_t * buf, size_t size)
+{
+	esp8266_http_conn & k = _conns[_current];
+	if (k.length == 0) return 0;
+	
+	unsigned long start = millis();
+	while (esp8266.tcpAvailable(_current) == 0) {
+		if (!esp8266.tcpConnected(_current)) return ESP8266_RSP_FAIL;
+		if (millis() - start >= HTTP_REQUEST_TIMEOUT) return ESP8266_RSP_TIMEOUT;
+	}
+	int n = esp8266.tcpRead(_current, buf, min((uint32_t)size, k.length));
+	if (n > 0) k.length -= n;
+	return n;
+}
+
+void Esp8266HttpServer::send(int status, PGM_P contentType, const char * body)
+{
+	send(status, contentType, (const uint8_t *)body, strlen(body));
+}
+
+void Esp8266HttpServer::send(int status, PGM_P contentType, const uint8_t * body, size_t length)
+{
+	esp8266_iovec v;
+	segment(v, body, length, false);
+	sendHeaders(status, contentType, length, &v);
+}
+
+void Esp8266HttpServer::send_P(int status, PGM_P contentType, const uint8_t * body, size_t length)
+{
+	esp8266_iovec v;
+	segment(v, body, length, true);
+	sendHeaders(status, contentType, length, &v);
+}
+
+void Esp8266HttpServer::beginResponse(int status, PGM_P contentType, int32_t length)
+{
+	// only the close can tell where the body ends
+	if (length < 0) _closing = true;
+	sendHeaders(status, contentType, length, NULL);
+}
+
+size_t Esp8266HttpServer::write(uint8_t c)
+{
+	return write(&c, 1);
+}
+
+size_t Esp8266HttpServer::write(const uint8_t *buf, size_t size)
+{
+	if (_out == NULL || !_responded) return 0;
+	if (_conns[_current].method == ESP8266_HTTP_HEAD) return size;
+	return _out->write(buf, size);
+}
+
+// reason phrase as body
+void Esp8266HttpServer::sendError(int status)
+{
+	PGM_P text = reason(status);
+	send_P(status, ESP8266_HTTP_TEXT, (const uint8_t *)text, strlen_P(text));
+}
+
+// status line and headers straight from flash, with the body (if any) in
+// the same vectored write
+void Esp8266HttpServer::sendHeaders(int status, PGM_P contentType, int32_t length, const esp8266_iovec * body)
+{
+	if (_responded) return;
+	_responded = true;
+	
+	esp8266_iovec iov[10];
+	uint8_t n = 0;
+	char num[16];	// status, then length
+	char * p = putNum(num, status);
+	*p++ = ' ';
+	segment(iov[n++], statusStart, sizeof(statusStart) - 1, true);
+	segment(iov[n++], num, p - num, false);
+	PGM_P text = reason(status);
+	segment(iov[n++], text, strlen_P(text), true);
+	if (contentType) {
+		segment(iov[n++], typeHeader, sizeof(typeHeader) - 1, true);
+		segment(iov[n++], contentType, strlen_P(contentType), true);
+	}
+	if (length >= 0) {
+		char * q = p;
+		p = putNum(p, length);
+		segment(iov[n++], lengthHeader, sizeof(lengthHeader) - 1, true);
+		segment(iov[n++], q, p - q, false);
+	}
+	if (_closing) segment(iov[n++], closeHeader, sizeof(closeHeader) - 1, true);
+	segment(iov[n++], headersEnd, sizeof(headersEnd) - 1, true);
+	if (body && body->len > 0 && _conns[_current].method != ESP8266_HTTP_HEAD)
+		iov[n++] = *body;
+	
+	esp8266.tcpWritev(_current, iov, n);
+}
+
+#endif /* ESP8266_ENABLE_SERVER */
@@ -0,0 +1,155 @@
+/******************************************************************************
+esp8266_http_server.h
+
+HTTP/1.1 server on our TCP server, with a route table fixed at compile
+time and kept in flash.  Each link has its own small parser state, fed
+bytes as they come in, so requests on several links may arrive
+interleaved.  Nothing of a request is buffered but its query string
+(ESP8266_HTTP_QUERY_LEN): the path is matched against the table byte by
+byte, and of the headers only Content-Length and Connection are looked at.
+
+A route either names a handler, or static content in flash that is sent
+without copying.  Responses from send()/send_P() go out headers and body
+together in as few CIPSENDs as ESP8266_MAX_SEND_LEN allows, i.e. a page
+up to 2K in one.  Connections are kept alive unless the client asks for
+close (or speaks HTTP/1.0).
+
+	const char indexPath[] PROGMEM = "/";
+	const char indexPage[] PROGMEM = "<html>...</html>";
+	const char ledPath[] PROGMEM = "/led";
+	void led(Esp8266HttpServer & http);
+	const esp8266_http_route routes[] PROGMEM = {
+		{ ESP8266_HTTP_GET, indexPath, NULL, ESP8266_HTTP_HTML,
+			(const uint8_t *)indexPage, sizeof(indexPage) - 1 },
+		{ ESP8266_HTTP_ANY, ledPath, led },
+	};
+	Esp8266HttpServer http(80, routes, ESP8266_HTTP_ROUTES(routes));
+
+begin() once, then handle() from loop().
+******************************************************************************/
+
+#ifndef __esp8266_http_server_h__
+#define __esp8266_http_server_h__
+
+#include <Arduino.h>
+
+#include "esp8266_lib.h"
+#include "esp8266_client.h"
+
+#if ESP8266_ENABLE_SERVER
+
+// ms a handler's read() waits for more of the request body
+#define HTTP_REQUEST_TIMEOUT 5000
+
+enum esp8266_http_method {
+	ESP8266_HTTP_ANY,		// routes only: all methods
+	ESP8266_HTTP_GET,		// routes: HEAD as well
+	ESP8266_HTTP_HEAD,
+	ESP8266_HTTP_POST,
+	ESP8266_HTTP_PUT,
+	ESP8266_HTTP_DELETE,
+	ESP8266_HTTP_OTHER
+};
+
+class Esp8266HttpServer;
+
+// answers the current request through the server's send()/beginResponse()
+typedef void (*esp8266_http_handler)(Esp8266HttpServer & http);
+
+struct esp8266_http_route {
+	uint8_t method;			// esp8266_http_method
+	PGM_P path;				// exact; ending in '*' matches all that start so
+	esp8266_http_handler handler;	// NULL: static content below
+	PGM_P contentType;
+	const uint8_t * content;	// PROGMEM
+	uint16_t length;
+};
+
+#define ESP8266_HTTP_ROUTES(r) (sizeof(r) / sizeof((r)[0]))
+
+// only the first 32 routes of a table are looked at
+#define ESP8266_HTTP_MAX_ROUTES 32
+
+// common content types, for routes and send()
+extern const char ESP8266_HTTP_HTML[] PROGMEM;
+extern const char ESP8266_HTTP_TEXT[] PROGMEM;
+extern const char ESP8266_HTTP_JSON[] PROGMEM;
+
+class Esp8266HttpServer : public Print {
+
+public:
+	Esp8266HttpServer(uint16_t port, const esp8266_http_route * routes, uint8_t count);
+
+	bool begin();
+	void end();
+	// reads what has come in and answers complete requests, at most one
+	// per link each call
+	void handle();
+
+	// the request being answered, for handlers
+	uint8_t method() { return _conns[_current].method; }
+	const char * query() { return _conns[_current].query; }	// "" if none
+	uint32_t contentLength() { return _conns[_current].length; }
+	uint8_t link() { return _current; }
+	// request body, at most size; 0 once all is read, <0 on error.  What
+	// the handler leaves unread is skipped.
+	int read(uint8_t * buf, size_t size);
+
+	// the response, all in one go; contentType in flash
+	void send(int status, PGM_P contentType, const char * body);
+	void send(int status, PGM_P contentType, const uint8_t * body, size_t length);
+	void send_P(int status, PGM_P contentType, const uint8_t * body, size_t length);
+	// or headers now and body through write()/print(); without a length
+	// the connection is closed to end it
+	void beginResponse(int status, PGM_P contentType, int32_t length = -1);
+	virtual size_t write(uint8_t);
+	virtual size_t write(const uint8_t *buf, size_t size);
+	using Print::write;
+
+private:
+	enum http_parse_state {
+		HTTP_METHOD,
+		HTTP_PATH,
+		HTTP_QUERY,
+		HTTP_VERSION,
+		HTTP_HEADER_NAME,
+		HTTP_HEADER_VALUE,
+		HTTP_SKIP_BODY		// handler did not read it all
+	};
+
+	// per link parser state
+	struct esp8266_http_conn {
+		uint8_t state;		// http_parse_state
+		uint8_t pos;		// chars of current token
+		uint8_t match;		// methods or header names current token may still be
+		uint8_t method;
+		uint32_t routes;	// routes the path may still be, a bit each
+		uint8_t star;		// 1 + route whose '*' the path has reached; 0: none
+		uint32_t length;	// Content-Length; while skipping, what is left
+		bool close;			// HTTP/1.0 or Connection: close
+		char query[ESP8266_HTTP_QUERY_LEN];
+	};
+
+	PGM_P routePath(uint8_t i);
+	void reset(uint8_t link);
+	bool feed(uint8_t link, char c);
+	void matchPath(esp8266_http_conn & k, char c);
+	void endPath(esp8266_http_conn & k);
+	void dispatch(uint8_t link);
+	void sendHeaders(int status, PGM_P contentType, int32_t length, const esp8266_iovec * body);
+	void sendError(int status);
+
+	uint16_t _port;
+	const esp8266_http_route * _routes;
+	uint8_t _count;
+	esp8266_http_conn _conns[ESP8266_MAX_SOCK_NUM];
+	// request being answered
+	uint8_t _current;
+	bool _responded;
+	bool _closing;			// close link once response is out
+	Esp8266Client * _out;	// streamed body, see beginResponse()
+};
+
+#endif /* ESP8266_ENABLE_SERVER */
+
+#endif /* __esp8266_http_server_h__ */
@@ -7,72 +7,264 @@
 #include "esp8266_debug.h"
 #include "esp8266_lib.h"
 
+// keyword slots of Esp8266::_matcher
+#define MATCH_PASS				0
+#define MATCH_FAIL				1
+#define MATCH_CONNECT			2
+#define MATCH_CLOSED			3
+#define MATCH_IPD				4
+#define MATCH_WIFI_DISCONNECT	5
+#define MATCH_WIFI_GOT_IP		6
+#define MATCH_BUSY				7
+#define MATCH_SEND_OK			8
+#define MATCH_SEND_FAIL			9
+#define MATCH_RECV_DATA			10
+
+#define MATCH_ASYNC_MASK	(~(ESP8266_MATCH(MATCH_PASS) | ESP8266_MATCH(MATCH_FAIL)))
+
 
 ////////////////////////
 // Buffer Definitions //
 ////////////////////////
-#define ESP8266_RX_BUFFER_LEN 128 // Number of bytes in the serial receive buffer
+// sizes are in esp8266_config.h
 char esp8266RxBuffer[ESP8266_RX_BUFFER_LEN];
 unsigned int bufferHead; // Holds position of latest byte placed in buffer.
 
+// TCP payload of each link is absorbed into its own ring as +IPD frames arrive
+uint8_t esp8266LinkRxBuffer[ESP8266_MAX_SOCK_NUM][ESP8266_LINK_RX_BUFFER_LEN];
+
+// rates begin() probes and steps through, lowest first
+static const uint32_t baudRates[] PROGMEM = {
+	9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600
+};
+#define BAUD_RATES (sizeof(baudRates) / sizeof(baudRates[0]))
+
+static void ignoreResult(esp8266_handle, int16_t) {}
+
+#if ESP8266_ENABLE_FAST_JOIN
+// steps of connectAPFast(), in cmd.mode
+#define JOIN_FAST		0x01	// connectAPFast(), not connectAP()
+#define JOIN_STARTED	0x02	// first command is out, join time is running
+#define JOIN_STATIC		0x04	// CIPSTA_CUR (or CWDHCP_CUR to undo it) goes next
+#define JOIN_BSSID		0x08	// join the BSSID we know
+#define JOIN_LEARN		0x10	// joined; CWJAP_CUR? goes next for the BSSID
+#endif
+
+char * esp8266IpToStr(IPAddress ip, char * buf)
+{
+	char * p = buf;
+	for (uint8_t i = 0; i < 4; i++) {
+		uint8_t n = ip[i];
+		if (n >= 100) *p++ = '0' + n / 100;
+		if (n >= 10) *p++ = '0' + n / 10 % 10;
+		*p++ = '0' + n % 10;
+		*p++ = '.';
+	}
+	p[-1] = 0;
+	return buf;
+}
+
+#if ESP8266_ENABLE_DNS_CACHE || ESP8266_ENABLE_POOL
+// FNV-1a of lower case name, then port; never 0, which marks a free entry
+static uint32_t nameHash(const char * name, uint16_t port = 0)
+{
+	uint32_t h = 2166136261UL;
+	while (*name) {
+		h ^= (uint8_t)tolower(*name++);
+		h *= 16777619UL;
+	}
+	h ^= port;
+	h *= 16777619UL;
+	return h ? h : 1;
+}
+#endif
+
 ////////////////////
 // Initialization //
 ////////////////////
 
-Esp8266::Esp8266(SoftwareSerial *swSerial)
+#if ESP8266_SOFTWARE_SERIAL
+Esp8266::Esp8266(SoftwareSerial *swSerial) : _serial(swSerial)
+{
+	init();
+}
+#endif
+
+Esp8266::Esp8266(HardwareSerial *hwSerial) : _serial(hwSerial)
+{
+	init();
+}
+
+Esp8266::Esp8266(Stream *stream, const esp8266_transport_hooks * hooks) : _serial(stream, hooks)
 {
-	_serial = swSerial;
+	init();
+}
+
+void Esp8266::init()
+{
+	_matcher.set(MATCH_CONNECT, RESPONSE_CONNECT);
+	_matcher.set(MATCH_CLOSED, RESPONSE_CLOSED);
+	_matcher.set(MATCH_IPD, RESPONSE_IPD);
+	_matcher.set(MATCH_WIFI_DISCONNECT, RESPONSE_WIFI_DISCONNECT);
+	_matcher.set(MATCH_WIFI_GOT_IP, RESPONSE_WIFI_GOT_IP);
+	_matcher.set(MATCH_BUSY, RESPONSE_BUSY);
+	_matcher.set(MATCH_SEND_OK, RESPONSE_SEND_OK);
+	_matcher.set(MATCH_SEND_FAIL, RESPONSE_SEND_FAIL);
+#if ESP8266_ENABLE_PASSIVE_RECV
+	_matcher.set(MATCH_RECV_DATA, ESP8266_RECV_DATA);
+#endif
+	
+	memset(_eventHandlers, 0, sizeof(_eventHandlers));
+	memset(_links, 0, sizeof(_links));
+	memset(_cmds, 0, sizeof(_cmds));
+#if ESP8266_ENABLE_DNS_CACHE
+	dnsFlush();
+#endif
+#if ESP8266_ENABLE_FAST_JOIN
+	memset(&_join, 0, sizeof(_join));
+#endif
+#if ESP8266_ENABLE_STATS
+	memset(&_stats, 0, sizeof(_stats));
+#endif
 }
 
-int16_t Esp8266::begin(unsigned long baudRate)
+int16_t Esp8266::begin(unsigned long baudRate, unsigned long maxBaud)
 {
-	_serial->begin(baudRate);
+	_baud = baudRate;
+	_baudIndex = ESP8266_BAUD_CUSTOM;
+	for (uint8_t i = 0; i < BAUD_RATES; i++)
+		if (pgm_read_dword(&baudRates[i]) == baudRate) _baudIndex = i;
+	_serial.begin(baudRate);
+	setRxGap(baudRate);
 
-	if (test() < 0) return ESP8266_RSP_FAIL;
+	if (test() < 0) {
+		if (maxBaud == 0 || probeBaud() < 0) return ESP8266_RSP_FAIL;
+	}
+	_baudFloor = _baudIndex;
 	if (setMux(1) < 0)	return ESP8266_RSP_FAIL;
 	if (echo(false) < 0) return ESP8266_RSP_FAIL;
+	
+	// no harm if this fails, we stay at a rate that works
+	if (maxBaud > _baud && _baudIndex != ESP8266_BAUD_CUSTOM)
+		upgradeBaud(maxBaud);
+	_rxErrors = 0;
+
+	return ESP8266_RSP_SUCCESS;
+}
+
+unsigned long Esp8266::baudRate()
+{
+	return _baud;
+}
 
+// one character is 10 bits on the wire (8N1)
+void Esp8266::setRxGap(unsigned long baudRate)
+{
+	_rxGapMicros = ESP8266_RX_GAP_CHARS * 10UL * 1000000UL / baudRate;
+	if (_rxGapMicros == 0) _rxGapMicros = 1;
+}
+
+// switch our side only
+void Esp8266::setBaud(uint8_t index)
+{
+	_baudIndex = index;
+	_baud = pgm_read_dword(&baudRates[index]);
+	_serial.begin(_baud);
+	setRxGap(_baud);
+	clearBuffer();
+	ESP8266_TRACE(ESP8266_TRACE_BAUD, index, 0);
+}
+
+// find the rate ESP8266 is running at; the first command at a new rate
+// may be spoiled by garbage of the previous attempt, so each gets two tries
+int16_t Esp8266::probeBaud()
+{
+	unsigned long tried = _baud;
+	for (uint8_t i = 0; i < BAUD_RATES; i++) {
+		if (pgm_read_dword(&baudRates[i]) == tried) continue;
+		setBaud(i);
+		if (test() >= 0 || test() >= 0) return ESP8266_RSP_SUCCESS;
+	}
+	return ESP8266_RSP_FAIL;
+}
+
+// try rates from maxBaud down until one passes verification
+int16_t Esp8266::upgradeBaud(unsigned long maxBaud)
+{
+	// reference answer at a rate known to work
+	int16_t rsp = command(ESP8266_OP_GET_MAC);
+	if (rsp <= 0) return ESP8266_RSP_FAIL;
+	uint16_t length = rsp;
+	uint16_t sum = bufferSum();
+	
+	uint8_t from = _baudIndex;
+	for (uint8_t i = BAUD_RATES - 1; i > from; i--) {
+		if (pgm_read_dword(&baudRates[i]) > maxBaud) continue;
+		// OK comes back at old rate, then both sides switch
+		if (command(ESP8266_OP_UART, i) < 0) continue;
+		if (verifyBaud(length, sum) >= 0) return ESP8266_RSP_SUCCESS;
+		
+		// back to known good rate; its OK may well get lost, so we 
+		// switch our side anyway
+		command(ESP8266_OP_UART, from);
+		setBaud(from);
+		if (test() < 0 && test() < 0) return ESP8266_RSP_FAIL;
+	}
+	return ESP8266_RSP_FAIL;
+}
+
+// same query a few times in a row; every answer has to match the reference
+// exactly, which catches dropped or corrupted bytes in receive direction
+int16_t Esp8266::verifyBaud(uint16_t length, uint16_t sum)
+{
+	for (uint8_t r = 0; r < ESP8266_BAUD_VERIFY_ROUNDS; r++) {
+		int16_t rsp = command(ESP8266_OP_GET_MAC);
+		if (rsp != (int16_t)length || bufferSum() != sum)
+			return ESP8266_RSP_FAIL;
+	}
 	return ESP8266_RSP_SUCCESS;
 }
 
+uint16_t Esp8266::bufferSum()
+{
+	uint16_t sum = 0;
+	for (unsigned int i = 0; i < bufferHead; i++)
+		sum = ((sum << 1) | (sum >> 15)) + (uint8_t)esp8266RxBuffer[i];
+	return sum;
+}
+
 ///////////////////////
 // Basic AT Commands //
 ///////////////////////
 
 int16_t Esp8266::test()
 {
-	sendCommand(ESP8266_TEST); // Send AT
-
-	return readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
+	return command(ESP8266_OP_TEST); // Send AT
 }
 
 int16_t Esp8266::echo(bool enable)
 {
-	if (enable)
-		sendCommand(ESP8266_ECHO_ENABLE);
-	else
-		sendCommand(ESP8266_ECHO_DISABLE);
-	
-	return readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
+	return command(ESP8266_OP_ECHO, enable);
 }
 
+#if ESP8266_ENABLE_VERSION
 int16_t Esp8266::getVersion(char * ATversion, char * SDKversion, char * compileTime)
 {
-	sendCommand(ESP8266_VERSION); // Send AT+GMR
+	// Send AT+GMR
 	// Example Response: AT version:0.30.0.0(Jul  3 2015 19:35:49)\r\n (43 chars)
 	//                   SDK version:1.2.0\r\n (19 chars)
 	//                   compile time:Jul  7 2015 18:34:26\r\n (36 chars)
 	//                   OK\r\n
 	// (~101 characters)
 	// Look for "OK":
-	int16_t rsp = (readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT) > 0);
+	int16_t rsp = (command(ESP8266_OP_VERSION) > 0);
 	if (rsp > 0)
 	{
 		char *p, *q;
 		// Look for "AT version" in the rxBuffer
-		p = strstr(esp8266RxBuffer, "AT version:");
+		p = strstr_P(esp8266RxBuffer, PSTR("AT version:"));
 		if (p == NULL) return ESP8266_RSP_UNKNOWN;
-		p += strlen("AT version:");
+		p += sizeof("AT version:") - 1;
 		q = strchr(p, '\r'); // Look for \r
 		if (q == NULL) return ESP8266_RSP_UNKNOWN;
 		if (ATversion) {
@@ -81,9 +273,9 @@ int16_t Esp8266::getVersion(char * ATversion, char * SDKversion, char * compileT
 		}
 		
 		// Look for "SDK version:" in the rxBuffer
-		p = strstr(esp8266RxBuffer, "SDK version:");
+		p = strstr_P(esp8266RxBuffer, PSTR("SDK version:"));
 		if (p == NULL) return ESP8266_RSP_UNKNOWN;
-		p += strlen("SDK version:");
+		p += sizeof("SDK version:") - 1;
 		q = strchr(p, '\r'); // Look for \r
 		if (q == NULL) return ESP8266_RSP_UNKNOWN;
 		if (SDKversion) {
@@ -92,9 +284,9 @@ int16_t Esp8266::getVersion(char * ATversion, char * SDKversion, char * compileT
 		}
 		
 		// Look for "compile time:" in the rxBuffer
-		p = strstr(esp8266RxBuffer, "compile time:");
+		p = strstr_P(esp8266RxBuffer, PSTR("compile time:"));
 		if (p == NULL) return ESP8266_RSP_UNKNOWN;
-		p += strlen("compile time:");
+		p += sizeof("compile time:") - 1;
 		q = strchr(p, '\r'); // Look for \r
 		if (q == NULL) return ESP8266_RSP_UNKNOWN;
 		if (compileTime) {
@@ -105,6 +297,7 @@ int16_t Esp8266::getVersion(char * ATversion, char * SDKversion, char * compileT
 	
 	return rsp;
 }
+#endif
 
 ////////////////////
 // WiFi Functions //
@@ -112,7 +305,7 @@ int16_t Esp8266::getVersion(char * ATversion, char * SDKversion, char * compileT
 
 int16_t Esp8266::connectAP(const char * ssid)
 {
-	connectAP(ssid, "");
+	return connectAP(ssid, "");
 }
 
 // connect()
@@ -122,39 +315,142 @@ int16_t Esp8266::connectAP(const char * ssid)
 //    - Fail: <0 (esp8266_cmd_rsp)
 int16_t Esp8266::connectAP(const char * ssid, const char * pwd)
 {
-	// Send : AT+CWJAP="ssid","pwd"
-	clearBuffer();
-	if (pwd)
-		sprintf(esp8266RxBuffer,"\"%s\",\"%s\"",ssid,pwd);
-	else
-		sprintf(esp8266RxBuffer,"\"%s\"",ssid);
+	waitForSlot();
+	return runCommand(connectAPAsync(ssid, pwd));
+}
+
+esp8266_handle Esp8266::connectAPAsync(const char * ssid, const char * pwd, esp8266_cmd_handler handler)
+{
+	esp8266_handle h = queueCommand(ESP8266_OP_CONNECT_AP, handler);
+	if (h < 0) return h;
+	_cmds[h].str = ssid;
+	_cmds[h].str2 = pwd;
+	return h;
+}
+
+#if ESP8266_ENABLE_FAST_JOIN
+int16_t Esp8266::connectAPFast(const char * ssid, const char * pwd)
+{
+	waitForSlot();
+	return runCommand(connectAPFastAsync(ssid, pwd));
+}
+
+esp8266_handle Esp8266::connectAPFastAsync(const char * ssid, const char * pwd, esp8266_cmd_handler handler)
+{
+	esp8266_handle h = connectAPAsync(ssid, pwd ? pwd : "", handler);
+	if (h < 0) return h;
 	
-	sendCommand(ESP8266_CONNECT_AP,ESP8266_CMD_SETUP,esp8266RxBuffer);
+	uint8_t mode = JOIN_FAST;
+	if (_staticIp || staticIp()) mode |= JOIN_STATIC;
+	for (uint8_t i = 0; i < sizeof(_join.bssid); i++) {
+		if (_join.bssid[i]) mode |= JOIN_BSSID;
+	}
+	_cmds[h].mode = mode;
+	return h;
+}
+
+bool Esp8266::staticIp()
+{
+	return _join.ip[0] || _join.ip[1] || _join.ip[2] || _join.ip[3];
+}
+
+void Esp8266::setStaticIP(IPAddress ip, IPAddress gateway, IPAddress netmask)
+{
+	for (uint8_t i = 0; i < 4; i++) {
+		_join.ip[i] = ip[i];
+		_join.gateway[i] = gateway[i];
+		_join.netmask[i] = netmask[i];
+	}
+}
+
+// "00:aa:bb:cc:dd:ee" into buf of at least 18 chars; returns buf
+static char * macToStr(const uint8_t * mac, char * buf)
+{
+	static const char hex[] PROGMEM = "0123456789abcdef";
+	char * p = buf;
+	for (uint8_t i = 0; i < 6; i++) {
+		*p++ = pgm_read_byte(&hex[mac[i] >> 4]);
+		*p++ = pgm_read_byte(&hex[mac[i] & 0xf]);
+		*p++ = ':';
+	}
+	p[-1] = 0;
+	return buf;
+}
+
+// one step of connectAPFast() answered; true if another one goes out
+bool Esp8266::joinStep(esp8266_cmd & cmd, int16_t & result)
+{
+	if (cmd.mode & JOIN_STATIC) {
+		// address not taken: join with DHCP then
+		if (result >= 0) _staticIp = staticIp();
+		cmd.mode &= ~JOIN_STATIC;
+		return true;
+	}
+	if (cmd.mode & JOIN_LEARN) {
+		if (result >= 0) parseJoin();
+		result = cmd.result;	// the join's
+		return false;
+	}
+	if (result < 0 && (cmd.mode & JOIN_BSSID)) {
+		// AP is gone or busy; look for the ssid wherever it is
+		memset(_join.bssid, 0, sizeof(_join.bssid));
+		_join.channel = 0;
+		cmd.mode &= ~JOIN_BSSID;
+		return true;
+	}
+	if (result >= 0 && !(cmd.mode & JOIN_BSSID)) {
+		// remember which AP took us, for next time
+		cmd.result = result;
+		cmd.mode |= JOIN_LEARN;
+		return true;
+	}
+	return false;
+}
+
+// BSSID and channel from CWJAP_CUR? into _join
+void Esp8266::parseJoin()
+{
+	// Example : +CWJAP_CUR:"WiFiSSID","00:aa:bb:cc:dd:ee",6,-45
+	char * p = strstr_P(esp8266RxBuffer, ESP8266_CONNECT_AP);
+	if (p == NULL) return;
+	p = strstr_P(p, PSTR("\",\""));
+	if (p == NULL) return;
+	p += 3;
 	
-	return readForResponses(RESPONSE_OK, RESPONSE_FAIL, WIFI_CONNECT_TIMEOUT);
+	uint8_t bssid[6];
+	for (uint8_t i = 0; i < 6; i++) {
+		if (i > 0 && *p++ != ':') return;
+		if (!isxdigit(p[0]) || !isxdigit(p[1])) return;
+		char byte[3] = { p[0], p[1], 0 };
+		bssid[i] = strtoul(byte, NULL, 16);
+		p += 2;
+	}
+	if (strncmp_P(p, PSTR("\","), 2) != 0) return;
+	memcpy(_join.bssid, bssid, sizeof(bssid));
+	_join.channel = atoi(p + 2);
 }
+#endif
 
 int16_t Esp8266::getAP(char * ssid)
 {
-	sendCommand(ESP8266_CONNECT_AP, ESP8266_CMD_QUERY); // Send "AT+CWJAP?"
+	int16_t rsp = command(ESP8266_OP_GET_AP); // Send "AT+CWJAP?"
 	
-	int16_t rsp = readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
 	// Example Responses: No AP\r\n\r\nOK\r\n
 	// - or -
 	// +CWJAP:"WiFiSSID","00:aa:bb:cc:dd:ee",6,-45\r\n\r\nOK\r\n
 	if (rsp > 0)
 	{
 		// Look for "No AP"
-		if (strstr(esp8266RxBuffer, "No AP") != NULL) {
+		if (strstr_P(esp8266RxBuffer, PSTR("No AP")) != NULL) {
 			ssid[0]=0;
 			return ESP8266_RSP_SUCCESS;
 		}
 		
 		// Look for "+CWJAP"
-		char * p = strstr(esp8266RxBuffer, ESP8266_CONNECT_AP);
+		char * p = strstr_P(esp8266RxBuffer, ESP8266_CONNECT_AP);
 		if (p != NULL)
 		{
-			p += strlen(ESP8266_CONNECT_AP) + 2;
+			p += strlen_P(ESP8266_CONNECT_AP) + 2;
 			char * q = strchr(p, '"');
 			if (q == NULL) return ESP8266_RSP_UNKNOWN;
 			strncpy(ssid, p, q-p);
@@ -168,10 +464,16 @@ int16_t Esp8266::getAP(char * ssid)
 
 int16_t Esp8266::disconnectAP()
 {
-	sendCommand(ESP8266_DISCONNECT); // Send AT+CWQAP
+	waitForSlot();
+	return runCommand(disconnectAPAsync());
+}
+
+esp8266_handle Esp8266::disconnectAPAsync(esp8266_cmd_handler handler)
+{
+	// Send AT+CWQAP
 	// Example response: \r\n\r\nOK\r\nWIFI DISCONNECT\r\n
 	// "WIFI DISCONNECT" comes up to 500ms _after_ OK. 
-	return readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
+	return queueCommand(ESP8266_OP_DISCONNECT_AP, handler);
 }
 
 // localIP()
@@ -181,17 +483,17 @@ int16_t Esp8266::disconnectAP()
 //    - Fail: 0
 int16_t Esp8266::getLocalIP(IPAddress &returnIP)
 {
-	sendCommand(ESP8266_GET_LOCAL_IP); // Send AT+CIFSR\r\n
+	// Send AT+CIFSR\r\n
 	// Example Response: +CIFSR:STAIP,"192.168.0.114"\r\n
 	//                   +CIFSR:STAMAC,"18:fe:34:9d:b7:d9"\r\n
 	//                   \r\n
 	//                   OK\r\n
 	// Look for the OK:
-	int16_t rsp = readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
+	int16_t rsp = command(ESP8266_OP_GET_IP);
 	if (rsp <= 0) return rsp;
 
 	// Look for "STAIP" in the rxBuffer
-	char * p = strstr(esp8266RxBuffer, "STAIP");
+	char * p = strstr_P(esp8266RxBuffer, PSTR("STAIP"));
 	if (p != NULL)
 	{
 		p += 7; // Move p seven places. (skip STAIP,")
@@ -216,17 +518,15 @@ int16_t Esp8266::getLocalIP(IPAddress &returnIP)
 
 int16_t Esp8266::getLocalMAC(char * mac)
 {
-	sendCommand(ESP8266_GET_STA_MAC, ESP8266_CMD_QUERY); // Send "AT+CIPSTAMAC?"
-
-	int16_t rsp = readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
+	int16_t rsp = command(ESP8266_OP_GET_MAC); // Send "AT+CIPSTAMAC?"
 
 	if (rsp > 0)
 	{
 		// Look for "+CIPSTAMAC"
-		char * p = strstr(esp8266RxBuffer, ESP8266_GET_STA_MAC);
+		char * p = strstr_P(esp8266RxBuffer, ESP8266_GET_STA_MAC);
 		if (p != NULL)
 		{
-			p += strlen(ESP8266_GET_STA_MAC) + 2;
+			p += strlen_P(ESP8266_GET_STA_MAC) + 2;
 			char * q = strchr(p, '"');
 			if (q == NULL) return ESP8266_RSP_UNKNOWN;
 			strncpy(mac, p, q - p); // Copy string to temp char array:
@@ -244,166 +544,1297 @@ int16_t Esp8266::getLocalMAC(char * mac)
 
 int16_t Esp8266::tcpConnect(const char * destination, uint16_t port, uint16_t keepAlive)
 {
-	ASSERT(_tcpState == ESP8266_TCP_NONE);
+	return tcpConnect(0, destination, port, keepAlive);
+}
+
+int16_t Esp8266::tcpConnect(uint8_t link, const char * destination, uint16_t port, uint16_t keepAlive)
+{
+	if (link < ESP8266_MAX_SOCK_NUM && tcpConnected(link)) return ESP8266_RSP_FAIL;
 	
-	if (tcpConnected()) return ESP8266_RSP_FAIL;
+	waitForSlot();
+	return runCommand(tcpConnectAsync(link, destination, port, keepAlive));
+}
+
+esp8266_handle Esp8266::tcpConnectAsync(uint8_t link, const char * destination, uint16_t port, uint16_t keepAlive, esp8266_cmd_handler handler)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return ESP8266_CMD_BAD;
+	if (_links[link].connected || _links[link].state != ESP8266_TCP_NONE) return ESP8266_RSP_FAIL;
+#if ESP8266_ENABLE_DNS_CACHE
+	// known not to resolve: no need to ask again just yet
+	uint8_t ip[4];
+	if (dnsLookup(destination, ip) == ESP8266_RSP_FAIL) return ESP8266_RSP_FAIL;
+#endif
 	
-	// Send : AT+CIPSTART="TCP","192.168.101.110",1000
-	clearBuffer();
-	sprintf(esp8266RxBuffer,"%d,\"TCP\",\"%s\",%d,%d", 0, destination, port, keepAlive/500);
-	sendCommand(ESP8266_TCP_CONNECT, ESP8266_CMD_SETUP, esp8266RxBuffer);
-		
-	// Example good: CONNECT\r\n\r\nOK\r\n
-	// Example bad: DNS Fail\r\n\r\nERROR\r\n
-	// Example meh: ALREADY CONNECTED\r\n\r\nERROR\r\n
-	int16_t result = readForResponses(RESPONSE_OK, RESPONSE_ERROR, CLIENT_CONNECT_TIMEOUT);
-	if (result >= 0) 
-		_tcpState = ESP8266_TCP_CLIENT;
+	esp8266_handle h = queueCommand(ESP8266_OP_TCP_CONNECT, handler);
+	if (h < 0) return h;
+	_cmds[h].link = link;
+	_cmds[h].str = destination;
+	_cmds[h].num = port;
+	_cmds[h].num2 = keepAlive;
 	
-	return result;
+	// reserve link until command completes
+	resetLink(link);
+	_links[link].state = ESP8266_TCP_CLIENT;
+	return h;
+}
+
+uint8_t Esp8266::getFreeLink()
+{
+	poll();
+	
+	// ESP8266 hands out ids for incoming server connections from 0 upwards,
+	// so we pick client ids from the top to stay out of its way
+	for (uint8_t link = ESP8266_MAX_SOCK_NUM; link-- > 0; ) {
+		if (_links[link].state == ESP8266_TCP_NONE && !_links[link].connected
+				&& _links[link].rxCount == 0 && _links[link].rxHeld == 0
+				&& !(_tcpDataSize > 0 && _tcpDataLink == link))
+			return link;
+	}
+	return ESP8266_SOCK_NOT_AVAIL;
 }
 
 bool Esp8266::tcpConnected()
 {
-	readForAsync(0);
-	return _tcpConnected;
+	return tcpConnected(0);
+}
+
+bool Esp8266::tcpConnected(uint8_t link)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return false;
+	poll();
+	return _links[link].connected;
 }
 
 int16_t Esp8266::tcpWrite(const char * msg)
 {
-	return tcpWrite((const uint8_t*)msg, strlen(msg));
+	return tcpWrite(0, msg);
+}
+
+int16_t Esp8266::tcpWrite(uint8_t link, const char * msg)
+{
+	return tcpWrite(link, (const uint8_t*)msg, strlen(msg));
 }
 
 int16_t Esp8266::tcpWrite(const uint8_t *buf, size_t size)
 {
-	if (size > 2048)
-		return ESP8266_CMD_BAD;
-	char params[8];
-	sprintf(params, "%d,%d", 0, size);
-	sendCommand(ESP8266_TCP_SEND, ESP8266_CMD_SETUP, params);
-	
-	int16_t rsp = readForResponses(RESPONSE_OK, RESPONSE_ERROR, COMMAND_RESPONSE_TIMEOUT);
-	if (rsp > 0)
-	{
-		write(buf, size);
-		rsp = readForResponse("SEND OK", COMMAND_RESPONSE_TIMEOUT);
-		
-		if (rsp > 0)
-			return size;
+	return tcpWrite(0, buf, size);
+}
+
+int16_t Esp8266::tcpWrite(uint8_t link, const uint8_t *buf, size_t size)
+{
+	esp8266_iovec one = { buf, size, false };
+	int32_t n = tcpWritev(link, &one, 1);
+	return n > 0x7fff ? 0x7fff : n;
+}
+
+// buf must stay valid until the command completes
+esp8266_handle Esp8266::tcpWriteAsync(uint8_t link, const uint8_t *buf, size_t size, esp8266_cmd_handler handler)
+{
+	esp8266_iovec one = { buf, size, false };
+	esp8266_handle h = tcpWritevAsync(link, &one, 1, handler);
+	if (h >= 0) {
+		// caller's iov is gone by the time we send; keep it in the slot
+		_cmds[h].one = one;
+		_cmds[h].iov = &_cmds[h].one;
+	}
+	return h;
+}
+
+int32_t Esp8266::tcpWritev(uint8_t link, const esp8266_iovec * iov, uint8_t iovcnt)
+{
+	if (_passthrough) {
+		// straight onto the wire; ESP8266 packs it into TCP segments
+		if (link != 0) return ESP8266_CMD_BAD;
+		int32_t n = 0;
+		for (uint8_t i = 0; i < iovcnt; i++) {
+			writeSegment(iov[i], 0, iov[i].len);
+			n += iov[i].len;
+		}
+#if ESP8266_ENABLE_STATS
+		_stats.tcpTxBytes += n;
+#endif
+		return n;
 	}
 	
-	return rsp;
+	waitForSlot();
+	esp8266_handle h = tcpWritevAsync(link, iov, iovcnt);
+	if (h < 0) return h;
+	
+	// result saturates at 16 bits, so pick up the byte count ourselves
+	while (_cmds[h].state != ESP8266_CMD_DONE)
+		poll();
+	uint32_t sent = _cmds[h].sent;
+	int16_t result = cmdResult(h);
+	
+	// like Print::write(), a partial write counts
+	return (result < 0 && sent == 0) ? result : (int32_t)sent;
+}
+
+// iov and the buffers it points to must stay valid until the command completes
+esp8266_handle Esp8266::tcpWritevAsync(uint8_t link, const esp8266_iovec * iov, uint8_t iovcnt, esp8266_cmd_handler handler)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return ESP8266_CMD_BAD;
+	
+	uint32_t total = 0;
+	for (uint8_t i = 0; i < iovcnt; i++)
+		total += iov[i].len;
+	if (total == 0) return ESP8266_CMD_BAD;		// CIPSEND won't take 0 bytes
+	
+	esp8266_handle h = queueCommand(ESP8266_OP_TCP_SEND, handler);
+	if (h < 0) return h;
+	_cmds[h].link = link;
+	_cmds[h].iov = iov;
+	_cmds[h].iovcnt = iovcnt;
+	_cmds[h].left = total;
+	return h;
 }
 
 int Esp8266::tcpAvailable()
 {
-	ASSERT(_tcpConnected);
-	readForAsync(0);
-	return _tcpDataSize;
+	return tcpAvailable(0);
+}
+
+int Esp8266::tcpAvailable(uint8_t link)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return 0;
+	poll();
+	
+	// bytes of current +IPD frame not yet absorbed are still in serial buffer
+	int size = _links[link].rxCount;
+	if (_tcpDataSize > 0 && _tcpDataLink == link)
+		size += _tcpDataSize;
+	if (_passthrough && link == 0)
+		size += _serial.available();
+	size += _links[link].rxHeld;
+	// only the current datagram counts
+	if (_links[link].state == ESP8266_TCP_UDP)
+		size = min(size, (int)_links[link].udpLeft);
+	return size;
 }
 
 uint8_t Esp8266::tcpRead()
 {
-	ASSERT(_tcpDataSize > 0);
-	while (!_serial->available());
-	_tcpDataSize--;
-	return _serial->read();
+	return tcpRead(0);
+}
+
+uint8_t Esp8266::tcpRead(uint8_t link)
+{
+	uint8_t c = 0;
+	VERIFY(tcpRead(link, &c, 1), == 1);
+	return c;
 }
 
 int16_t Esp8266::tcpRead(uint8_t *buf, size_t size) 
 {
-	ASSERT(_tcpDataSize > 0);
-	size_t s = min(_tcpDataSize, size);
-	for (int i=0; i< s; i++)
-		buf[i] = tcpRead();
+	return tcpRead(0, buf, size);
+}
+
+// copy out of the link's rx ring; refill it from pending +IPD payload
+// (which may be spread over several frames) until size is met or
+// nothing more is available for this link.  What ESP8266 holds in passive
+// receive costs a CIPRECVDATA round trip, so we only wait for it when we
+// have nothing yet.
+int16_t Esp8266::tcpRead(uint8_t link, uint8_t *buf, size_t size) 
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return ESP8266_CMD_BAD;
+	
+	esp8266_link & l = _links[link];
+	uint8_t * ring = esp8266LinkRxBuffer[link];
+	if (l.state == ESP8266_TCP_UDP) size = min(size, (size_t)l.udpLeft);
+	size_t s = 0;
+	while (s < size) {
+		if (l.rxCount == 0) {
+			if (s > 0 && l.rxHeld > 0
+			    && !(_tcpDataSize > 0 && _tcpDataLink == link)) break;
+			if (tcpAvailable(link) == 0) break;
+			continue;
+		}
+		
+		// at most two block copies: up to end of ring, then wrapped part
+		uint16_t n = min((size_t)l.rxCount, size - s);
+		uint16_t first = min(n, (uint16_t)(ESP8266_LINK_RX_BUFFER_LEN - l.rxHead));
+		memcpy(buf + s, ring + l.rxHead, first);
+		memcpy(buf + s + first, ring, n - first);
+		l.rxHead = (l.rxHead + n) % ESP8266_LINK_RX_BUFFER_LEN;
+		l.rxCount -= n;
+		s += n;
+	}
+	if (l.state == ESP8266_TCP_UDP) l.udpLeft -= s;
+	return s;
 }
 
 int Esp8266::tcpPeek()
 {
-	ASSERT(_tcpConnected);
-	readForAsync(0);
-	return _serial->peek();
+	return tcpPeek(0);
+}
+
+int Esp8266::tcpPeek(uint8_t link)
+{
+	if (tcpAvailable(link) == 0) return -1;
+	
+	// pending payload is taken in by poll(), passively held one fetched
+	esp8266_link & l = _links[link];
+	while (l.rxCount == 0)
+		if (tcpAvailable(link) == 0) return -1;
+	return esp8266LinkRxBuffer[link][l.rxHead];
 }
 
 int16_t Esp8266::tcpClose()
 {
-	char params[2];
-	sprintf(params, "%d", 0);
-	sendCommand(ESP8266_TCP_CLOSE, ESP8266_CMD_SETUP, params);
+	return tcpClose(0);
+}
+
+int16_t Esp8266::tcpClose(uint8_t link)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return ESP8266_CMD_BAD;
+	if (_passthrough && link == 0) return tcpPassthroughStop();
+	
+	// unread data is dropped either way
+	if (_tcpDataSize > 0 && _tcpDataLink == link) drainTcpData();
+	_links[link].rxCount = 0;
+	_links[link].udpLeft = 0;
+	_links[link].rxHeld = 0;
+	
+	// closed by remote already; nothing to tell ESP8266
+	if (!tcpConnected(link)) {
+		resetLink(link);
+		return ESP8266_RSP_SUCCESS;
+	}
 	
-	return readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
+	waitForSlot();
+	return runCommand(tcpCloseAsync(link));
 }
 
-int16_t Esp8266::setMux(uint8_t mux)
+esp8266_handle Esp8266::tcpCloseAsync(uint8_t link, esp8266_cmd_handler handler)
 {
-	char params[2] = {0, 0};
-	params[0] = (mux > 0) ? '1' : '0';
-	sendCommand(ESP8266_TCP_MULTIPLE, ESP8266_CMD_SETUP, params);
+	if (link >= ESP8266_MAX_SOCK_NUM) return ESP8266_CMD_BAD;
 	
-	return readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
+	esp8266_handle h = queueCommand(ESP8266_OP_TCP_CLOSE, handler);
+	if (h >= 0) _cmds[h].link = link;
+	return h;
 }
 
-int16_t Esp8266::tcpServerStart(uint16_t port)
+#if ESP8266_ENABLE_POOL
+bool Esp8266::tcpPark(uint8_t link)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return false;
+	esp8266_link & l = _links[link];
+	if (!tcpConnected(link) || l.poolKey == 0 || tcpAvailable(link) > 0) return false;
+	
+	l.parked = true;
+	l.parkedAt = millis();
+	return true;
+}
+
+uint8_t Esp8266::tcpReuse(const char * host, uint16_t port)
+{
+	poll();		// take in CLOSED from remote
+	expirePool();
+	
+	uint32_t key = nameHash(host, port);
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++) {
+		esp8266_link & l = _links[link];
+		if (!l.parked || l.poolKey != key) continue;
+		// whatever came in while parked belongs to no one
+		if (tcpAvailable(link) > 0) {
+			tcpClose(link);
+			continue;
+		}
+		l.parked = false;
+		return link;
+	}
+	return ESP8266_SOCK_NOT_AVAIL;
+}
+
+uint8_t Esp8266::tcpEvict()
+{
+	expirePool();
+	
+	uint8_t oldest = ESP8266_SOCK_NOT_AVAIL;
+	unsigned long now = millis();
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++) {
+		if (!_links[link].parked) continue;
+		if (oldest == ESP8266_SOCK_NOT_AVAIL
+				|| now - _links[link].parkedAt > now - _links[oldest].parkedAt)
+			oldest = link;
+	}
+	if (oldest != ESP8266_SOCK_NOT_AVAIL) tcpClose(oldest);
+	return getFreeLink();
+}
+
+void Esp8266::tcpPoolClose()
+{
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++)
+		if (_links[link].parked) tcpClose(link);
+}
+
+void Esp8266::expirePool()
+{
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++) {
+		esp8266_link & l = _links[link];
+		if (l.parked && millis() - l.parkedAt >= ESP8266_POOL_IDLE_TIMEOUT)
+			tcpClose(link);
+	}
+}
+#endif
+
+#if ESP8266_ENABLE_UDP
+int16_t Esp8266::udpOpen(uint8_t link, const char * remote, uint16_t remotePort, uint16_t localPort, uint8_t mode)
+{
+	if (link < ESP8266_MAX_SOCK_NUM && tcpConnected(link)) return ESP8266_RSP_FAIL;
+	
+	waitForSlot();
+	return runCommand(udpOpenAsync(link, remote, remotePort, localPort, mode));
+}
+
+esp8266_handle Esp8266::udpOpenAsync(uint8_t link, const char * remote, uint16_t remotePort, uint16_t localPort, uint8_t mode, esp8266_cmd_handler handler)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return ESP8266_CMD_BAD;
+	if (_links[link].connected || _links[link].state != ESP8266_TCP_NONE) return ESP8266_RSP_FAIL;
+	
+	esp8266_handle h = queueCommand(ESP8266_OP_UDP_OPEN, handler);
+	if (h < 0) return h;
+	_cmds[h].link = link;
+	_cmds[h].str = remote;
+	_cmds[h].num2 = remotePort;
+	_cmds[h].num3 = localPort;
+	_cmds[h].mode = mode;
+	
+	// reserve link; "<link>,CONNECT" marks it connected
+	resetLink(link);
+	_links[link].state = ESP8266_TCP_UDP;
+	return h;
+}
+
+int16_t Esp8266::udpWrite(uint8_t link, const uint8_t * buf, size_t size, const char * remote, uint16_t remotePort)
+{
+	waitForSlot();
+	return runCommand(udpWriteAsync(link, buf, size, remote, remotePort));
+}
+
+// a datagram can't be split over several CIPSEND
+esp8266_handle Esp8266::udpWriteAsync(uint8_t link, const uint8_t * buf, size_t size, const char * remote, uint16_t remotePort, esp8266_cmd_handler handler)
 {
-	ASSERT(_tcpState == ESP8266_TCP_NONE);
+	if (link >= ESP8266_MAX_SOCK_NUM || _links[link].state != ESP8266_TCP_UDP) return ESP8266_CMD_BAD;
+	if (size > ESP8266_MAX_SEND_LEN) return ESP8266_CMD_BAD;
+	
+	esp8266_handle h = tcpWriteAsync(link, buf, size, handler);
+	if (h >= 0) {
+		_cmds[h].str = remote;
+		_cmds[h].num2 = remotePort;
+	}
+	return h;
+}
 
-	char params[10];	
-	sprintf(params, "1,%d", port);
-	sendCommand(ESP8266_SERVER_CONFIG, ESP8266_CMD_SETUP, params);	
-	int16_t ret = readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
-	if (ret >= 0) _tcpState = ESP8266_TCP_SERVER;
+int16_t Esp8266::udpParse(uint8_t link, IPAddress & remote, uint16_t & remotePort)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM || _links[link].state != ESP8266_TCP_UDP) return ESP8266_CMD_BAD;
+	esp8266_link & l = _links[link];
+	
+	// whatever is left of current datagram
+	uint8_t skip[16];
+	while (l.udpLeft > 0 && tcpRead(link, skip, sizeof(skip)) > 0);
+	
+	poll();
+	if (l.rxCount < ESP8266_UDP_HEADER_LEN) return 0;
+	uint8_t h[ESP8266_UDP_HEADER_LEN];
+	l.udpLeft = ESP8266_UDP_HEADER_LEN;
+	tcpRead(link, h, ESP8266_UDP_HEADER_LEN);
 	
-	return ret;
+	remote = IPAddress(h[2], h[3], h[4], h[5]);
+	remotePort = h[6] | (h[7] << 8);
+	l.udpLeft = h[0] | (h[1] << 8);
+	return l.udpLeft;
+}
+#endif
+
+void Esp8266::resetLink(uint8_t link)
+{
+	_links[link].state = ESP8266_TCP_NONE;
+	_links[link].connected = false;
+	_links[link].rxHead = 0;
+	_links[link].rxCount = 0;
+	_links[link].udpLeft = 0;
+	_links[link].rxHeld = 0;
+#if ESP8266_ENABLE_POOL
+	_links[link].poolKey = 0;
+	_links[link].parked = false;
+#endif
+}
+
+int16_t Esp8266::setMux(uint8_t mux)
+{
+	return command(ESP8266_OP_MUX, mux > 0);
+}
+
+#if ESP8266_ENABLE_SERVER
+int16_t Esp8266::tcpServerStart(uint16_t port)
+{
+	ASSERT(!_serverStarted);
+
+	return command(ESP8266_OP_SERVER, port);
 }
 
 int16_t Esp8266::tcpServerStop()
 {
-	ASSERT(_tcpState == ESP8266_TCP_SERVER);
+	ASSERT(_serverStarted);
+	
+	return command(ESP8266_OP_SERVER, 0);
+}
+
+uint8_t Esp8266::tcpAccept()
+{
+	poll();
 	
-	char params[]="0";
-	sendCommand(ESP8266_SERVER_CONFIG, ESP8266_CMD_SETUP, params);
-	int16_t ret = readForResponse(RESPONSE_OK, COMMAND_RESPONSE_TIMEOUT);
-	if (ret >= 0) _tcpState = ESP8266_TCP_NONE;
-	return ret;
+	while (_accepted > 0) {
+		uint8_t link = _acceptQueue[0];
+		_accepted--;
+		memmove(_acceptQueue, _acceptQueue + 1, _accepted);
+		// gone meanwhile, or id reused for one of our clients
+		esp8266_link & l = _links[link];
+		if (l.state == ESP8266_TCP_SERVER || (l.state == ESP8266_TCP_NONE && tcpAvailable(link) > 0))
+			return link;
+	}
+	return ESP8266_SOCK_NOT_AVAIL;
+}
+#endif
+
+/*
+  entering: CIPMUX=0, CIPSTART, CIPMODE=1, then CIPSEND without length is 
+  answered with '>' and from there on the UART is the TCP connection.
+  leaving: "+++" on its own, with some silence around it, ends data mode but
+  leaves the connection open; CIPMODE=0, CIPCLOSE, CIPMUX=1 bring us back.
+  Link 0 holds the connection state throughout.
+*/
+int16_t Esp8266::tcpPassthroughStart(const char * destination, uint16_t port, uint16_t keepAlive)
+{
+	if (_passthrough || _serverStarted || _passiveRecv || cmdBusy()) return ESP8266_RSP_FAIL;
+#if ESP8266_ENABLE_POOL
+	tcpPoolClose();
+#endif
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++) {
+		if (_links[link].state != ESP8266_TCP_NONE || _links[link].connected)
+			return ESP8266_RSP_FAIL;
+	}
+	
+	int16_t rsp = setMux(0);
+	if (rsp < 0) return rsp;
+	rsp = tcpConnect(0, destination, port, keepAlive);
+	if (rsp >= 0) rsp = command(ESP8266_OP_CIPMODE, 1);
+	if (rsp >= 0) rsp = command(ESP8266_OP_PASSTHROUGH);
+	if (rsp >= 0) return ESP8266_RSP_SUCCESS;
+	
+	// undo whatever got through
+	command(ESP8266_OP_CIPMODE, 0);
+	if (_links[0].connected) tcpClose(0);
+	resetLink(0);
+	setMux(1);
+	return rsp;
+}
+
+int16_t Esp8266::tcpPassthroughStop()
+{
+	if (!_passthrough) return ESP8266_RSP_FAIL;
+	
+	passthroughWait(PASSTHROUGH_ESCAPE_GAP);
+	_serial.print(F("+++"));
+	passthroughWait(PASSTHROUGH_EXIT_TIMEOUT);
+	_passthrough = false;
+	
+	int16_t rsp = command(ESP8266_OP_CIPMODE, 0);
+	tcpClose(0);		// fails if remote has closed already; fine
+	resetLink(0);
+	int16_t mux = setMux(1);
+	return rsp < 0 ? rsp : mux;
+}
+
+#if ESP8266_ENABLE_PASSIVE_RECV
+int16_t Esp8266::tcpPassiveRecv(bool enable)
+{
+	if (_passthrough) return ESP8266_CMD_BAD;
+	
+	return command(ESP8266_OP_RECV_MODE, enable);
+}
+#endif
+
+// keep taking in what remote sends while the line has to stay quiet
+void Esp8266::passthroughWait(unsigned int ms)
+{
+	unsigned long start = millis();
+	while (millis() - start < ms)
+		absorbTcpData();
 }
 
+#if ESP8266_ENABLE_PING
 int16_t Esp8266::ping(IPAddress ip)
 {
-	char ipStr[17];
-	sprintf(ipStr, "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
-	return ping(ipStr);
+	char ipStr[16];
+	return ping(esp8266IpToStr(ip, ipStr));
+}
+
+int16_t Esp8266::ping(const char * server)
+{
+	waitForSlot();
+	return runCommand(pingAsync(server));
+}
+
+// result is round trip time in ms; 0 on ping timeout
+esp8266_handle Esp8266::pingAsync(const char * server, esp8266_cmd_handler handler)
+{
+	esp8266_handle h = queueCommand(ESP8266_OP_PING, handler);
+	if (h >= 0) _cmds[h].str = server;
+	return h;
 }
 
-int16_t Esp8266::ping(char * server)
+// Example responses:
+//  * Good response: +12\r\n\r\nOK\r\n
+//  * Timeout response: +timeout\r\n\r\nERROR\r\n
+//  * Error response (unreachable): ERROR\r\n\r\n
+int16_t Esp8266::parsePing(int16_t rsp)
 {
-	char params[strlen(server) + 3];
-	sprintf(params, "\"%s\"", server);
-	// Send AT+Ping=<server>
-	sendCommand(ESP8266_PING, ESP8266_CMD_SETUP, params); 
-	// Example responses:
-	//  * Good response: +12\r\n\r\nOK\r\n
-	//  * Timeout response: +timeout\r\n\r\nERROR\r\n
-	//  * Error response (unreachable): ERROR\r\n\r\n
-	int16_t rsp = readForResponses(RESPONSE_OK, RESPONSE_ERROR, COMMAND_PING_TIMEOUT);
 	if (rsp > 0)
 	{
-		char * p = searchBuffer("+");
+		char * p = searchBuffer(PSTR("+"));
+		if (p == NULL)
+			return ESP8266_RSP_UNKNOWN;
 		p += 1; // Move p forward 1 space
 		char * q = strchr(p, '\r'); // Find the first \r
 		if (q == NULL)
 			return ESP8266_RSP_UNKNOWN;
-		char tempRsp[10];
-		strncpy(tempRsp, p, q - p);
-		return atoi(tempRsp);
+		return atoi(p);
 	}
 	else
 	{
-		if (searchBuffer("timeout") != NULL)
+		if (searchBuffer(PSTR("timeout")) != NULL)
 			return 0;
 	}
 	
 	return rsp;
 }
+#endif
+
+#if ESP8266_ENABLE_DNS_CACHE
+///////////////
+// DNS Cache //
+///////////////
+
+// address at p into ip; returns what follows it, NULL if it is none
+static const char * parseIp(const char * p, uint8_t * ip)
+{
+	for (uint8_t i = 0; i < 4; i++) {
+		if (i > 0 && *p++ != '.') return NULL;
+		size_t n = strspn(p, "0123456789");
+		if (n == 0 || n > 3 || atoi(p) > 255) return NULL;
+		ip[i] = atoi(p);
+		p += n;
+	}
+	return p;
+}
+
+int16_t Esp8266::resolve(const char * host, IPAddress & ip)
+{
+	uint8_t a[4];
+	int16_t rsp = dnsLookup(host, a);
+	if (rsp == ESP8266_RSP_PENDING) {
+		waitForSlot();
+		esp8266_handle h = queueCommand(ESP8266_OP_DOMAIN, NULL);
+		if (h >= 0) _cmds[h].str = host;
+		rsp = runCommand(h);
+		if (rsp >= 0) rsp = dnsLookup(host, a);
+	}
+	if (rsp >= 0) ip = IPAddress(a);
+	return rsp;
+}
+
+void Esp8266::dnsFlush()
+{
+	memset(_dns, 0, sizeof(_dns));
+}
+
+// ESP8266_RSP_SUCCESS with ip filled in; ESP8266_RSP_FAIL if the name is
+// known not to resolve; ESP8266_RSP_PENDING if ESP8266 has to be asked
+int16_t Esp8266::dnsLookup(const char * host, uint8_t * ip)
+{
+	const char * end = parseIp(host, ip);
+	if (end && *end == 0) return ESP8266_RSP_SUCCESS;
+	
+	uint32_t hash = nameHash(host);
+	for (uint8_t i = 0; i < ESP8266_DNS_CACHE_LEN; i++) {
+		esp8266_dns_entry & e = _dns[i];
+		if (e.hash != hash) continue;
+		if ((long)(millis() - e.expires) >= 0) {
+			e.hash = 0;
+			break;
+		}
+		memcpy(ip, e.ip, 4);
+		return (ip[0] | ip[1] | ip[2] | ip[3]) ? ESP8266_RSP_SUCCESS : ESP8266_RSP_FAIL;
+	}
+	return ESP8266_RSP_PENDING;
+}
+
+// ip NULL: name did not resolve
+void Esp8266::dnsStore(const char * host, const uint8_t * ip)
+{
+	uint32_t hash = nameHash(host);
+	unsigned long now = millis();
+	
+	// same name, else the entry closest to expiry; free ones count as expired
+	esp8266_dns_entry * e = NULL;
+	long least = 0;
+	for (uint8_t i = 0; i < ESP8266_DNS_CACHE_LEN; i++) {
+		esp8266_dns_entry & c = _dns[i];
+		if (c.hash == hash) {
+			e = &c;
+			break;
+		}
+		long left = c.hash ? (long)(c.expires - now) : -1;
+		if (e == NULL || left < least) {
+			e = &c;
+			least = left;
+		}
+	}
+	
+	e->hash = hash;
+	if (ip) memcpy(e->ip, ip, 4);
+	else memset(e->ip, 0, 4);
+	e->expires = now + (ip ? ESP8266_DNS_TTL : ESP8266_DNS_FAIL_TTL);
+}
+
+void Esp8266::dnsForget(const char * host)
+{
+	uint32_t hash = nameHash(host);
+	for (uint8_t i = 0; i < ESP8266_DNS_CACHE_LEN; i++)
+		if (_dns[i].hash == hash) _dns[i].hash = 0;
+}
+
+// Example good: +CIPDOMAIN:93.184.216.34\r\n\r\nOK\r\n (newer firmware quotes it)
+// Example bad: DNS Fail\r\n\r\nERROR\r\n
+int16_t Esp8266::parseDomain(const char * host, int16_t rsp)
+{
+	// any other ERROR (no WiFi, busy) says nothing about the name
+	if (rsp == ESP8266_RSP_FAIL && searchBuffer(PSTR("DNS Fail")))
+		dnsStore(host, NULL);
+	if (rsp < 0) return rsp;
+	
+	char * p = searchBuffer(ESP8266_DOMAIN);
+	if (p == NULL) return ESP8266_RSP_UNKNOWN;
+	p += strlen_P(ESP8266_DOMAIN) + 1;
+	if (*p == '"') p++;
+	uint8_t ip[4];
+	if (parseIp(p, ip) == NULL) return ESP8266_RSP_UNKNOWN;
+	dnsStore(host, ip);
+	return rsp;
+}
+#endif
+
+////////////////////
+// Command Engine //
+////////////////////
+
+/*
+  Commands are queued in _cmds[] and executed one at a time, oldest first.
+  poll() moves the active command along:
+	- QUEUED: send AT command, start waiting for its response
+	- SENT: response matched or timed out; CIPSEND goes on to DATA
+	- DATA: payload written, waiting for SEND OK
+	- DONE: result is kept until cmdResult() collects it, unless a
+	  handler was given, in which case the slot is freed right away
+  Between commands poll() only looks for async messages.
+*/
+
+esp8266_handle Esp8266::queueCommand(uint8_t op, esp8266_cmd_handler handler)
+{
+	// anything we send in data mode goes to remote
+	if (_passthrough) return ESP8266_CMD_BAD;
+	
+	for (esp8266_handle h = 0; h < ESP8266_CMD_QUEUE_LEN; h++) {
+		esp8266_cmd & cmd = _cmds[h];
+		if (cmd.state != ESP8266_CMD_FREE) continue;
+		
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.op = op;
+		cmd.state = ESP8266_CMD_QUEUED;
+		cmd.handler = handler;
+		_cmdFifo[_cmdQueued++] = h;
+		return h;
+	}
+	return ESP8266_CMD_BAD;
+}
+
+// blocking callers wait for earlier commands to make room in the queue
+void Esp8266::waitForSlot()
+{
+	for (;;) {
+		for (uint8_t h = 0; h < ESP8266_CMD_QUEUE_LEN; h++)
+			if (_cmds[h].state == ESP8266_CMD_FREE) return;
+		if (!cmdBusy()) return;		// all slots hold uncollected results
+		poll();
+	}
+}
+
+int16_t Esp8266::runCommand(esp8266_handle h)
+{
+	if (h < 0) return h;
+	
+	int16_t result;
+	while ((result = cmdResult(h)) == ESP8266_RSP_PENDING)
+		poll();
+	return result;
+}
+
+// blocking command without string parameters
+int16_t Esp8266::command(uint8_t op, uint16_t num)
+{
+	waitForSlot();
+	esp8266_handle h = queueCommand(op, NULL);
+	if (h >= 0) _cmds[h].num = num;
+	return runCommand(h);
+}
+
+int16_t Esp8266::cmdResult(esp8266_handle h)
+{
+	if (h < 0 || h >= ESP8266_CMD_QUEUE_LEN || _cmds[h].state == ESP8266_CMD_FREE)
+		return ESP8266_CMD_BAD;
+	if (_cmds[h].state != ESP8266_CMD_DONE)
+		return ESP8266_RSP_PENDING;
+	
+	_cmds[h].state = ESP8266_CMD_FREE;
+	return _cmds[h].result;
+}
+
+bool Esp8266::cmdBusy()
+{
+	return _cmdActive >= 0 || _cmdQueued > 0;
+}
+
+void Esp8266::poll()
+{
+	// pending TCP payload blocks the serial stream until it fits a ring
+	absorbTcpData();
+	if (_passthrough) return;	// all input is payload
+	
+	// too many receive errors at this rate; step down once idle
+	if (_rxErrors >= ESP8266_BAUD_ERROR_LIMIT && !cmdBusy()
+			&& _baudIndex != ESP8266_BAUD_CUSTOM && _baudIndex > _baudFloor) {
+		esp8266_handle h = queueCommand(ESP8266_OP_UART, ignoreResult);
+		if (h >= 0) _cmds[h].num = _baudIndex - 1;
+		_rxErrors = 0;
+	}
+	
+#if ESP8266_ENABLE_PASSIVE_RECV
+	// fetch held payload as rings drain, while nothing else is going on
+	if (_passiveRecv && !cmdBusy()) queueRecv();
+#endif
+	
+	if (_cmdActive < 0 && _cmdQueued > 0) {
+		_cmdActive = _cmdFifo[0];
+		_cmdQueued--;
+		memmove(_cmdFifo, _cmdFifo + 1, _cmdQueued * sizeof(_cmdFifo[0]));
+#if ESP8266_ENABLE_STATS
+		_cmds[_cmdActive].start = micros();
+#endif
+		issueCommand(_cmds[_cmdActive]);
+	}
+	
+	int16_t result = stepResponse();
+	if (_cmdActive >= 0 && result != ESP8266_RSP_PENDING)
+		advanceCommand(result);
+}
+
+void Esp8266::issueCommand(esp8266_cmd & cmd)
+{
+	PGM_P pass = RESPONSE_OK;
+	PGM_P fail = RESPONSE_ERROR;
+	unsigned int timeout = COMMAND_RESPONSE_TIMEOUT;
+	
+	cmd.state = ESP8266_CMD_SENT;
+	ESP8266_TRACE(ESP8266_TRACE_CMD, cmd.op, cmd.link);
+	switch (cmd.op) {
+	case ESP8266_OP_TEST:
+		sendCommand(ESP8266_TEST); // Send AT
+		break;
+	case ESP8266_OP_ECHO:
+		sendCommand(cmd.num ? ESP8266_ECHO_ENABLE : ESP8266_ECHO_DISABLE);
+		break;
+	case ESP8266_OP_MUX:
+		beginCommand(ESP8266_TCP_MULTIPLE, ESP8266_CMD_SETUP);
+		sendArg(cmd.num);
+		endCommand();
+		break;
+#if ESP8266_ENABLE_VERSION
+	case ESP8266_OP_VERSION:
+		sendCommand(ESP8266_VERSION);
+		break;
+#endif
+	case ESP8266_OP_CONNECT_AP:
+#if ESP8266_ENABLE_FAST_JOIN
+		if (!(cmd.mode & JOIN_STARTED)) {
+			cmd.mode |= JOIN_STARTED;
+			_joinStart = millis();
+		}
+		if ((cmd.mode & JOIN_STATIC) && !staticIp()) {
+			// Send : AT+CWDHCP_CUR=1,1
+			beginCommand(ESP8266_DHCP_EN, ESP8266_CMD_SETUP);
+			sendArg(ESP8266_MODE_STA);
+			sendArg(1);
+			endCommand();
+			break;
+		}
+		if (cmd.mode & JOIN_STATIC) {
+			// Send : AT+CIPSTA_CUR="ip","gateway","netmask"
+			char ipStr[16];
+			beginCommand(ESP8266_SET_STA_IP, ESP8266_CMD_SETUP);
+			sendArg(esp8266IpToStr(IPAddress(_join.ip), ipStr));
+			sendArg(esp8266IpToStr(IPAddress(_join.gateway), ipStr));
+			sendArg(esp8266IpToStr(IPAddress(_join.netmask), ipStr));
+			endCommand();
+			break;
+		}
+		if (cmd.mode & JOIN_LEARN) {
+			sendCommand(ESP8266_CONNECT_AP, ESP8266_CMD_QUERY);
+			break;
+		}
+#endif
+		// Send : AT+CWJAP="ssid","pwd"[,"bssid"]
+		beginCommand(ESP8266_CONNECT_AP, ESP8266_CMD_SETUP);
+		sendArg(cmd.str);
+		if (cmd.str2) sendArg(cmd.str2);
+#if ESP8266_ENABLE_FAST_JOIN
+		if (cmd.mode & JOIN_BSSID) {
+			char bssid[18];
+			sendArg(macToStr(_join.bssid, bssid));
+		}
+#endif
+		endCommand();
+		fail = RESPONSE_FAIL;
+		timeout = WIFI_CONNECT_TIMEOUT;
+		break;
+	case ESP8266_OP_GET_AP:
+		sendCommand(ESP8266_CONNECT_AP, ESP8266_CMD_QUERY);
+		break;
+	case ESP8266_OP_DISCONNECT_AP:
+		sendCommand(ESP8266_DISCONNECT);
+		break;
+	case ESP8266_OP_GET_IP:
+		sendCommand(ESP8266_GET_LOCAL_IP);
+		break;
+	case ESP8266_OP_GET_MAC:
+		sendCommand(ESP8266_GET_STA_MAC, ESP8266_CMD_QUERY);
+		break;
+	case ESP8266_OP_TCP_CONNECT: {
+		// Send : AT+CIPSTART=0,"TCP","192.168.101.110",1000
+		// Example good: 0,CONNECT\r\n\r\nOK\r\n
+		// Example bad: DNS Fail\r\n\r\nERROR\r\n
+		// Example meh: ALREADY CONNECTED\r\n\r\nERROR\r\n
+		// single connection mode: AT+CIPSTART="TCP","192.168.101.110",1000
+		// Example good: CONNECT\r\n\r\nOK\r\n
+		const char * dest = cmd.str;
+#if ESP8266_ENABLE_DNS_CACHE
+		// host name not in cache: look it up first, CIPSTART follows
+		uint8_t ip[4];
+		char ipStr[16];
+		if (dnsLookup(cmd.str, ip) != ESP8266_RSP_SUCCESS) {
+			cmd.mode = 1;
+			beginCommand(ESP8266_DOMAIN, ESP8266_CMD_SETUP);
+			sendArg(cmd.str);
+			endCommand();
+			timeout = CLIENT_CONNECT_TIMEOUT;
+			break;
+		}
+		dest = esp8266IpToStr(IPAddress(ip), ipStr);
+#endif
+		beginCommand(ESP8266_TCP_CONNECT, ESP8266_CMD_SETUP);
+		if (_mux) sendArg(cmd.link);
+		sendArg_P(PSTR("TCP"));
+		sendArg(dest);
+		sendArg(cmd.num);
+		sendArg(cmd.num2 / 500);
+		endCommand();
+		timeout = CLIENT_CONNECT_TIMEOUT;
+		break;
+	}
+	case ESP8266_OP_TCP_SEND:
+		// next chunk of the payload
+		cmd.num = min(cmd.left, (uint32_t)ESP8266_MAX_SEND_LEN);
+		beginCommand(ESP8266_TCP_SEND, ESP8266_CMD_SETUP);
+		sendArg(cmd.link);
+		sendArg(cmd.num);
+		if (cmd.str) {
+			// UDP datagram to someone else than default remote
+			sendArg(cmd.str);
+			sendArg(cmd.num2);
+		}
+		endCommand();
+		break;
+	case ESP8266_OP_TCP_CLOSE:
+		// Example : 0,CLOSED\r\n\r\nOK\r\n
+		if (_mux) {
+			beginCommand(ESP8266_TCP_CLOSE, ESP8266_CMD_SETUP);
+			sendArg(cmd.link);
+			endCommand();
+		} else {
+			sendCommand(ESP8266_TCP_CLOSE);
+		}
+		break;
+#if ESP8266_ENABLE_SERVER
+	case ESP8266_OP_SERVER:
+		beginCommand(ESP8266_SERVER_CONFIG, ESP8266_CMD_SETUP);
+		sendArg(cmd.num > 0);
+		if (cmd.num) sendArg(cmd.num);
+		endCommand();
+		break;
+#endif
+#if ESP8266_ENABLE_PING
+	case ESP8266_OP_PING:
+		// Send AT+Ping=<server>
+		beginCommand(ESP8266_PING, ESP8266_CMD_SETUP);
+		sendArg(cmd.str);
+		endCommand();
+		timeout = COMMAND_PING_TIMEOUT;
+		break;
+#endif
+	case ESP8266_OP_CIPMODE:
+		beginCommand(ESP8266_TRANSMISSION_MODE, ESP8266_CMD_SETUP);
+		sendArg(cmd.num);
+		endCommand();
+		break;
+	case ESP8266_OP_PASSTHROUGH:
+		// AT+CIPSEND without length; Example: \r\nOK\r\n\r\n>
+		sendCommand(ESP8266_TCP_SEND);
+		pass = RESPONSE_PROMPT;
+		break;
+	case ESP8266_OP_UART:
+		// Send : AT+UART_CUR=115200,8,1,0,0
+		beginCommand(ESP8266_UART_CUR, ESP8266_CMD_SETUP);
+		sendArg(pgm_read_dword(&baudRates[cmd.num]));
+		_serial.print(F(",8,1,0,0"));
+		DEBUG_VERBOSE(Serial.print(F(",8,1,0,0")));
+		endCommand();
+		break;
+#if ESP8266_ENABLE_UDP
+	case ESP8266_OP_UDP_OPEN:
+		// first time round make sure +IPD tells us the sender
+		if (!_ipdInfo) {
+			beginCommand(ESP8266_IPD_INFO, ESP8266_CMD_SETUP);
+			sendArg(1);
+			endCommand();
+			break;
+		}
+		// Send : AT+CIPSTART=4,"UDP","192.168.101.110",1000,2000,2
+		// Example good: 4,CONNECT\r\n\r\nOK\r\n
+		beginCommand(ESP8266_TCP_CONNECT, ESP8266_CMD_SETUP);
+		sendArg(cmd.link);
+		sendArg_P(PSTR("UDP"));
+		sendArg(cmd.str);
+		sendArg(cmd.num2);
+		if (cmd.num3) {
+			sendArg(cmd.num3);
+			sendArg(cmd.mode);
+		}
+		endCommand();
+		timeout = CLIENT_CONNECT_TIMEOUT;
+		break;
+#endif
+#if ESP8266_ENABLE_PASSIVE_RECV
+	case ESP8266_OP_RECV_MODE:
+		beginCommand(ESP8266_RECV_MODE, ESP8266_CMD_SETUP);
+		sendArg(cmd.num);
+		endCommand();
+		break;
+	case ESP8266_OP_RECV_DATA:
+		// Send : AT+CIPRECVDATA=0,64
+		// Example : +CIPRECVDATA,64:<64 bytes>\r\nOK\r\n
+		beginCommand(ESP8266_RECV_DATA, ESP8266_CMD_SETUP);
+		sendArg(cmd.link);
+		sendArg(cmd.num);
+		endCommand();
+		break;
+	case ESP8266_OP_RECV_LEN:
+		// Example : +CIPRECVLEN:0,1460,0,0,0\r\n\r\nOK\r\n
+		// data announced from here on may or may not be counted in it
+		_recvLenStale = false;
+		sendCommand(ESP8266_RECV_LEN, ESP8266_CMD_QUERY);
+		break;
+#endif
+#if ESP8266_ENABLE_DNS_CACHE
+	case ESP8266_OP_DOMAIN:
+		// Send : AT+CIPDOMAIN="example.com"
+		beginCommand(ESP8266_DOMAIN, ESP8266_CMD_SETUP);
+		sendArg(cmd.str);
+		endCommand();
+		timeout = CLIENT_CONNECT_TIMEOUT;
+		break;
+#endif
+	default:
+		ASSERT(false);
+	}
+	
+	startResponse(pass, fail, timeout);
+}
+
+void Esp8266::advanceCommand(int16_t result)
+{
+	esp8266_handle h = _cmdActive;
+	esp8266_cmd & cmd = _cmds[h];
+	
+	if (cmd.op == ESP8266_OP_TCP_SEND && result > 0) {
+		// CIPSEND is answered with OK and '>'; now the chunk goes out
+		if (cmd.state == ESP8266_CMD_SENT) {
+			writeChunk(cmd);
+			cmd.state = ESP8266_CMD_DATA;
+			startResponse(RESPONSE_SEND_OK, RESPONSE_SEND_FAIL, COMMAND_RESPONSE_TIMEOUT);
+			return;
+		}
+		// SEND OK; go on with next chunk if there is more
+		cmd.sent += cmd.num;
+#if ESP8266_ENABLE_STATS
+		_stats.tcpTxBytes += cmd.num;
+#endif
+		cmd.left -= cmd.num;
+		if (cmd.left > 0) {
+			issueCommand(cmd);
+			return;
+		}
+	}
+	
+#if ESP8266_ENABLE_UDP
+	if (cmd.op == ESP8266_OP_UDP_OPEN && !_ipdInfo && result >= 0) {
+		// CIPDINFO=1 done, now the link itself
+		_ipdInfo = true;
+		issueCommand(cmd);
+		return;
+	}
+#endif
+	
+#if ESP8266_ENABLE_FAST_JOIN
+	if (cmd.op == ESP8266_OP_CONNECT_AP) {
+		// CWJAP itself answered: that is the join time
+		if (!(cmd.mode & (JOIN_STATIC | JOIN_LEARN))) _joinMillis = millis() - _joinStart;
+		if ((cmd.mode & JOIN_FAST) && joinStep(cmd, result)) {
+			issueCommand(cmd);
+			return;
+		}
+	}
+#endif
+	
+#if ESP8266_ENABLE_DNS_CACHE
+	if (cmd.op == ESP8266_OP_TCP_CONNECT && cmd.mode) {
+		// host name looked up; now connect to the address
+		result = parseDomain(cmd.str, result);
+		if (result >= 0) {
+			cmd.mode = 0;
+			issueCommand(cmd);
+			return;
+		}
+	}
+#endif
+	
+	endResponse();
+	_cmdActive = -1;
+	ESP8266_TRACE(ESP8266_TRACE_DONE, cmd.op, result);
+	// bytes came in but made no sense: count against current baud rate
+	if (result == ESP8266_RSP_UNKNOWN) {
+		if (_rxErrors < 255) _rxErrors++;
+	} else if (result >= 0 && _rxErrors > 0) {
+		_rxErrors--;
+	}
+#if ESP8266_ENABLE_STATS
+	countCommand(cmd, result);
+#endif
+	result = finishCommand(cmd, result);
+	
+	if (cmd.handler) {
+		cmd.state = ESP8266_CMD_FREE;
+		cmd.handler(h, result);
+	} else {
+		cmd.result = result;
+		cmd.state = ESP8266_CMD_DONE;
+	}
+}
+
+// update our state from command outcome; return final result
+int16_t Esp8266::finishCommand(esp8266_cmd & cmd, int16_t result)
+{
+	switch (cmd.op) {
+	case ESP8266_OP_TCP_CONNECT:
+		if (result < 0) {
+			resetLink(cmd.link);	// release reservation
+#if ESP8266_ENABLE_DNS_CACHE
+			// address may have moved; look it up again next time
+			if (!cmd.mode) dnsForget(cmd.str);
+#endif
+		}
+		else {
+			// no "<link>,CONNECT" in single connection mode
+			if (!_mux) _links[cmd.link].connected = true;
+#if ESP8266_ENABLE_POOL
+			_links[cmd.link].poolKey = nameHash(cmd.str, cmd.num);
+#endif
+		}
+		break;
+#if ESP8266_ENABLE_UDP
+	case ESP8266_OP_UDP_OPEN:
+		if (result < 0) resetLink(cmd.link);
+		break;
+#endif
+	case ESP8266_OP_TCP_SEND:
+		if (result > 0) result = min(cmd.sent, (uint32_t)0x7fff);
+		break;
+	case ESP8266_OP_TCP_CLOSE:
+		if (result >= 0) resetLink(cmd.link);
+		break;
+#if ESP8266_ENABLE_SERVER
+	case ESP8266_OP_SERVER:
+		if (result >= 0) {
+			_serverStarted = (cmd.num != 0);
+			_tcpServerPort = cmd.num;
+		}
+		break;
+#endif
+#if ESP8266_ENABLE_PING
+	case ESP8266_OP_PING:
+		result = parsePing(result);
+		break;
+#endif
+	case ESP8266_OP_MUX:
+		if (result >= 0) _mux = cmd.num;
+		break;
+	case ESP8266_OP_CONNECT_AP:
+		if (result >= 0) _wifiUp = true;
+		break;
+	case ESP8266_OP_DISCONNECT_AP:
+		if (result >= 0) _wifiUp = false;
+		break;
+	case ESP8266_OP_PASSTHROUGH:
+		if (result >= 0) _passthrough = true;
+		break;
+	case ESP8266_OP_UART:
+		// a garbled answer most likely means ESP8266 switched right 
+		// after sending OK, so we follow
+		if (result >= 0 || result == ESP8266_RSP_UNKNOWN) setBaud(cmd.num);
+		break;
+#if ESP8266_ENABLE_PASSIVE_RECV
+	case ESP8266_OP_RECV_MODE:
+		if (result >= 0) {
+			_passiveRecv = cmd.num;
+			// back in active mode, held data comes as ordinary +IPD
+			for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++)
+				_links[link].rxHeld = 0;
+		}
+		break;
+	case ESP8266_OP_RECV_DATA: {
+		esp8266_link & l = _links[cmd.link];
+		// less than we asked for means nothing is left
+		if (result < 0 || cmd.sent < cmd.num) l.rxHeld = 0;
+		if (result >= 0) result = cmd.sent;
+		break;
+	}
+	case ESP8266_OP_RECV_LEN:
+		result = parseRecvLen(result);
+		break;
+#endif
+#if ESP8266_ENABLE_DNS_CACHE
+	case ESP8266_OP_DOMAIN:
+		result = parseDomain(cmd.str, result);
+		break;
+#endif
+	}
+	return result;
+}
+
+#if ESP8266_ENABLE_STATS
+void Esp8266::countCommand(esp8266_cmd & cmd, int16_t result)
+{
+	uint8_t c;
+	switch (cmd.op) {
+	case ESP8266_OP_CONNECT_AP:
+	case ESP8266_OP_GET_AP:
+	case ESP8266_OP_DISCONNECT_AP:
+	case ESP8266_OP_GET_IP:
+	case ESP8266_OP_GET_MAC:
+		c = ESP8266_CLASS_WIFI;
+		break;
+	case ESP8266_OP_TCP_CONNECT:
+	case ESP8266_OP_TCP_CLOSE:
+	case ESP8266_OP_SERVER:
+	case ESP8266_OP_UDP_OPEN:
+	case ESP8266_OP_DOMAIN:
+		c = ESP8266_CLASS_LINK;
+		break;
+	case ESP8266_OP_TCP_SEND:
+		c = ESP8266_CLASS_SEND;
+		break;
+	case ESP8266_OP_RECV_DATA:
+	case ESP8266_OP_RECV_LEN:
+		c = ESP8266_CLASS_RECV;
+		break;
+	case ESP8266_OP_PING:
+		c = ESP8266_CLASS_PING;
+		break;
+	default:
+		c = ESP8266_CLASS_CONTROL;
+	}
+	
+	esp8266_cmd_stats & s = _stats.cmds[c];
+	uint32_t us = micros() - cmd.start;
+	s.count++;
+	if (result == ESP8266_RSP_TIMEOUT) s.timeouts++;
+	else if (result == ESP8266_RSP_UNKNOWN) s.unknown++;
+	else if (result < 0) s.failed++;
+	if (s.count == 1 || us < s.minMicros) s.minMicros = us;
+	if (us > s.maxMicros) s.maxMicros = us;
+	s.totalMicros += us;
+}
+
+const esp8266_stats & Esp8266::getStats()
+{
+	_stats.rxBytes = _serial.rxBytes;
+	_stats.txBytes = _serial.txBytes;
+	return _stats;
+}
+
+void Esp8266::resetStats()
+{
+	memset(&_stats, 0, sizeof(_stats));
+	_serial.rxBytes = 0;
+	_serial.txBytes = 0;
+}
+#endif
+
+// write cmd.num bytes of the payload, continuing where last chunk ended;
+// a chunk may span several segments and a segment several chunks
+void Esp8266::writeChunk(esp8266_cmd & cmd)
+{
+	uint16_t n = cmd.num;
+	while (n > 0) {
+		const esp8266_iovec & v = cmd.iov[cmd.seg];
+		size_t k = min(v.len - cmd.segOff, (size_t)n);
+		writeSegment(v, cmd.segOff, k);
+		n -= k;
+		cmd.segOff += k;
+		if (cmd.segOff == v.len) {
+			cmd.seg++;
+			cmd.segOff = 0;
+		}
+	}
+}
+
+// k bytes of v from off; flash goes through a small buffer
+void Esp8266::writeSegment(const esp8266_iovec & v, size_t off, size_t k)
+{
+	if (!v.progmem) {
+		write(v.buf + off, k);
+		return;
+	}
+	uint8_t buf[16];
+	while (k > 0) {
+		size_t n = min(k, sizeof(buf));
+		memcpy_P(buf, v.buf + off, n);
+		write(buf, n);
+		off += n;
+		k -= n;
+	}
+}
 
 //////////////////////////////////////////////////
 // Private, Low-Level, Ugly, Hardware Functions //
@@ -411,75 +1842,127 @@ int16_t Esp8266::ping(char * server)
 
 size_t Esp8266::write(const uint8_t* buf, size_t size)
 {
-	return _serial->write(buf, size);
+	return _serial.write(buf, size);
+}
+
+void Esp8266::sendCommand(PGM_P cmd, enum esp8266_command_type type)
+{
+	beginCommand(cmd, type);
+	endCommand();
 }
 
-void Esp8266::sendCommand(const char * cmd, enum esp8266_command_type type, const char * params)
+void Esp8266::beginCommand(PGM_P cmd, enum esp8266_command_type type)
 {
 	drainTcpData();	// we should not get into this situation often!
 	
-	_serial->print(F("AT"));
-	_serial->print(cmd);
+	_serial.print(F("AT"));
+	_serial.print((const __FlashStringHelper *)cmd);
 	DEBUG_VERBOSE(Serial.print(F("AT")));
-	DEBUG_VERBOSE(Serial.print(cmd));
+	DEBUG_VERBOSE(Serial.print((const __FlashStringHelper *)cmd));
 	if (type == ESP8266_CMD_QUERY) {
-		_serial->print(F("?"));
-		DEBUG_VERBOSE(Serial.print(F("?")));
-	} 
-	else if (type == ESP8266_CMD_SETUP)
-	{
-		_serial->print(F("="));
-		_serial->print(params);
-		DEBUG_VERBOSE(Serial.print(F("=")));
-		DEBUG_VERBOSE(Serial.print(params));
+		_serial.print('?');
+		DEBUG_VERBOSE(Serial.print('?'));
 	}
-	_serial->print(F("\r\n"));
-	DEBUG_VERBOSE(Serial.print(F("\r\n")));
+	_firstArg = true;
 }
 
-int16_t Esp8266::readForAsync(unsigned int timeout)
+void Esp8266::sendArg(unsigned long n)
 {
-	// don't check for async msg if we still have tcp data
-	if (_tcpDataSize > 0 ) 
-		return ESP8266_RSP_SUCCESS;
-	else
-		return readForResponses(NULL, NULL, timeout);
+	char c = _firstArg ? '=' : ',';
+	_firstArg = false;
+	_serial.print(c);
+	_serial.print(n);
+	DEBUG_VERBOSE(Serial.print(c));
+	DEBUG_VERBOSE(Serial.print(n));
 }
 
-int16_t Esp8266::readForResponse(const char * rsp, unsigned int timeout)
+void Esp8266::sendArg(const char * s)
 {
-	return readForResponses(rsp, NULL, timeout);
+	char c = _firstArg ? '=' : ',';
+	_firstArg = false;
+	_serial.print(c);
+	_serial.print('"');
+	_serial.print(s);
+	_serial.print('"');
+	DEBUG_VERBOSE(Serial.print(c));
+	DEBUG_VERBOSE(Serial.print(s));
 }
 
-/*
-  read sufficient chars and do async msg processing.
-  "sufficient chars" 
-	- drain all avaialbe chars on remote
-		- wait for maximum 2ms gap
-	- until we have a hit or 2ms gap timeout
-*/
-int16_t Esp8266::readForResponses(const char * pass, const char * fail, unsigned int timeout)
+void Esp8266::sendArg_P(PGM_P s)
+{
+	char c = _firstArg ? '=' : ',';
+	_firstArg = false;
+	_serial.print(c);
+	_serial.print('"');
+	_serial.print((const __FlashStringHelper *)s);
+	_serial.print('"');
+	DEBUG_VERBOSE(Serial.print(c));
+	DEBUG_VERBOSE(Serial.print((const __FlashStringHelper *)s));
+}
+
+void Esp8266::endCommand()
+{
+	_serial.print(F("\r\n"));
+	DEBUG_VERBOSE(Serial.print(F("\r\n")));
+}
+
+// begin waiting for pass or fail token of a command
+void Esp8266::startResponse(PGM_P pass, PGM_P fail, unsigned int timeout)
 {
 	ASSERT(_tcpDataSize == 0);
 	clearBuffer();	// Clear the class receive buffer (esp8266RxBuffer)
+	_matcher.set(MATCH_PASS, pass);
+	_matcher.set(MATCH_FAIL, fail);
+	_matcher.restart();
+	_rspWaiting = true;
+	_rspStart = millis();
+	_rspTimeout = timeout;
+}
 
-	// we persistent-read next char if available and scan for keywords
-	// if we run out of input, we check for timeout (outer loop)
-	unsigned long timeIn = millis();	// Timestamp coming into function
-	do {
-		for(;;) {
-			if (! readByteToBuffer()) break;
-			// if one of them is not NULL, we are in command mode; discard tcp data
-			checkAsyncMsg(pass || fail);	
-			if (pass)
-				if (searchBuffer(pass))	// Search the buffer for goodRsp
-					return bufferHead;	// Return how number of chars read
-			if (fail)
-				if (searchBuffer(fail))
-					return ESP8266_RSP_FAIL;
-		}
-	} while (millis() < timeIn + timeout); // While we haven't timed out
-	// Serial.println(F("\n==timeout==\n")); // jsun
+// back to looking for async messages only; response stays in buffer
+// until next line arrives so blocking callers can parse it
+void Esp8266::endResponse()
+{
+	_matcher.set(MATCH_PASS, NULL);
+	_matcher.set(MATCH_FAIL, NULL);
+	_rspWaiting = false;
+}
+
+/*
+  consume chars that have arrived so far and do async msg processing; never
+  waits for more.  Returns ESP8266_RSP_PENDING until pass or fail token of 
+  current command shows up or it times out, and always between commands.
+
+  every byte is fed once into _matcher, which tracks pass/fail tokens and
+  async messages at the same time (see esp8266_matcher.h)
+*/
+int16_t Esp8266::stepResponse()
+{
+	if (!_rspWaiting && bufferTail() == '\n') clearBuffer();
+	
+	while (readByteToBuffer(false)) {
+		uint16_t match = _matcher.feed(bufferTail());
+		if (match == 0) {
+			// between commands buffer only needs to hold current line
+			if (!_rspWaiting && bufferTail() == '\n') clearBuffer();
+			continue;
+		}
+		int16_t result = bufferHead;	// number of chars read
+		// if we are waiting for a command response, discard tcp data
+		// that does not fit into the rx ring
+		if (match & MATCH_ASYNC_MASK)
+			handleAsyncMsg(match, _rspWaiting);
+		if (_rspWaiting && (match & ~MATCH_ASYNC_MASK))
+			ESP8266_TRACE(ESP8266_TRACE_MATCH, _cmds[_cmdActive].op, match);
+		if (match & ESP8266_MATCH(MATCH_PASS))
+			return result;
+		if (match & ESP8266_MATCH(MATCH_FAIL))
+			return ESP8266_RSP_FAIL;
+	}
+	
+	if (!_rspWaiting || millis() - _rspStart < _rspTimeout)
+		return ESP8266_RSP_PENDING;
+	ESP8266_TRACE(ESP8266_TRACE_TIMEOUT, _cmds[_cmdActive].op, bufferHead);
 	
 	if (bufferHead > 0) // If we received any characters
 		return ESP8266_RSP_UNKNOWN; // Return unkown response error code
@@ -487,83 +1970,347 @@ int16_t Esp8266::readForResponses(const char * pass, const char * fail, unsigned
 		return ESP8266_RSP_TIMEOUT; // Return the timeout error code
 }
 
-bool Esp8266::checkAsyncMsg(bool discardTcpData)
+void Esp8266::onEvent(esp8266_event_type type, esp8266_event_handler handler)
+{
+	ASSERT(type < ESP8266_EVENT_NUM);
+	_eventHandlers[type] = handler;
+}
+
+void Esp8266::dispatchEvent(esp8266_event_type type, uint8_t link, uint16_t length)
+{
+	ESP8266_TRACE(ESP8266_TRACE_URC, type | link << 4, length);
+	if (_eventHandlers[type] == NULL) return;
+	
+	esp8266_event event;
+	event.type = type;
+	event.link = link;
+	event.length = length;
+	_eventHandlers[type](&event);
+}
+
+// return link id right before token at the end of rx buffer,
+// e.g. 1 for "1,CONNECT\r\n"
+uint8_t Esp8266::linkBefore(PGM_P token)
+{
+	int16_t idPos = (int16_t)bufferHead - (int16_t)strlen_P(token) - 1;
+	if (idPos < 0) return ESP8266_SOCK_NOT_AVAIL;
+	
+	char c = esp8266RxBuffer[idPos];
+	if (c < '0' || c >= '0' + ESP8266_MAX_SOCK_NUM) return ESP8266_SOCK_NOT_AVAIL;
+	return c - '0';
+}
+
+void Esp8266::handleAsyncMsg(uint16_t match, bool discardTcpData)
 {
-	bool flag=false;
+	if (match & ESP8266_MATCH(MATCH_CONNECT)) {
+		uint8_t link = linkBefore(RESPONSE_CONNECT);
+		if (link != ESP8266_SOCK_NOT_AVAIL) {
+			DEBUG_VERBOSE(Serial.println(F("\ntcp connected!")));
+			// not opened by tcpConnect(), must be a client of our server
+			// leftovers of a previous connection on this id are stale
+			if (_links[link].state == ESP8266_TCP_NONE) {
+				resetLink(link);
+				_links[link].state = ESP8266_TCP_SERVER;
+#if ESP8266_ENABLE_SERVER
+				uint8_t i = 0;
+				while (i < _accepted && _acceptQueue[i] != link) i++;
+				if (i == _accepted) _acceptQueue[_accepted++] = link;
+#endif
+			}
+			_links[link].connected = true;
+		}
+		dispatchEvent(ESP8266_EVENT_CONNECT, link, 0);
+	}
 	
-	if (searchBuffer(RESPONSE_CONNECT_0)) {
-		DEBUG_VERBOSE(Serial.println(F("\ntcp connected!")));
-		flag=true;
-		_tcpConnected=true;
-	} else if (searchBuffer(RESPONSE_CONNECT)) {
-		flag=true;
-		// this should only happen in server mode
-		Serial.println(F("TODO: non-0 connection detected"));
-		// Serial.println(esp8266RxBuffer);
-		// ASSERT(false);
+	if (match & ESP8266_MATCH(MATCH_CLOSED)) {
+		uint8_t link = linkBefore(RESPONSE_CLOSED);
+		if (link != ESP8266_SOCK_NOT_AVAIL) {
+			DEBUG_VERBOSE(Serial.println(F("\ntcp disconnected!")));
+			// multiple possibilities to get here:
+			// - we actively kill server
+			// - server's client disconnect
+			// - we are client and server disconnect
+			// - we actively called tcpClose()
+			_links[link].connected = false;
+			_links[link].state = ESP8266_TCP_NONE;
+#if ESP8266_ENABLE_POOL
+			// gone from the pool; nobody is going to read what is left
+			if (_links[link].parked) resetLink(link);
+#endif
+		}
+		dispatchEvent(ESP8266_EVENT_CLOSED, link, 0);
 	}
 	
-	// we don't care about non-zero channel closing
-	if (searchBuffer(RESPONSE_CLOSED_0)) {
-		DEBUG_VERBOSE(Serial.println(F("\ntcp disconnected!")));
-		flag=true;
-		_tcpConnected=false;
-		// multiple possibilities to get here:
-		// - we actively kill server
-		// - server's client disconnect
-		// - we are client and server disconnect
-		// - we actively called tcpClose()
-		if (_tcpState == ESP8266_TCP_CLIENT)	// quit client mode when session ends
-			_tcpState = ESP8266_TCP_NONE;		
+	if (match & ESP8266_MATCH(MATCH_WIFI_DISCONNECT)) {
+		_wifiUp = false;
+		dispatchEvent(ESP8266_EVENT_WIFI_DISCONNECT, ESP8266_SOCK_NOT_AVAIL, 0);
 	}
+	if (match & ESP8266_MATCH(MATCH_WIFI_GOT_IP)) {
+		_wifiUp = true;
+		dispatchEvent(ESP8266_EVENT_WIFI_GOT_IP, ESP8266_SOCK_NOT_AVAIL, 0);
+	}
+	if (match & ESP8266_MATCH(MATCH_BUSY))
+		dispatchEvent(ESP8266_EVENT_BUSY, ESP8266_SOCK_NOT_AVAIL, 0);
+	if (match & ESP8266_MATCH(MATCH_SEND_OK))
+		dispatchEvent(ESP8266_EVENT_SEND_OK, ESP8266_SOCK_NOT_AVAIL, 0);
+	if (match & ESP8266_MATCH(MATCH_SEND_FAIL))
+		dispatchEvent(ESP8266_EVENT_SEND_FAIL, ESP8266_SOCK_NOT_AVAIL, 0);
+	
+#if ESP8266_ENABLE_PASSIVE_RECV
+	if (match & ESP8266_MATCH(MATCH_RECV_DATA))
+		recvData();
+#endif
 	
 	// we have tcp data to read
 	// example
 	// 
 	// +IPD,0,357:GET /favicon.ico HTTP/1.1
 	// Host: 10.10.1.193
-	if (searchBuffer(RESPONSE_IPD)) {
+	//
+	// or in passive receive mode just the announcement
+	//
+	// +IPD,0,357
+	//
+	// In single connection mode (around passthrough, see
+	// tcpPassthroughStart()) there is no link id: +IPD,357:...
+	if (match & ESP8266_MATCH(MATCH_IPD)) {
 		ASSERT(_tcpDataSize == 0);
-		flag=true;
 		
-		// read until we have ":"
-		VERIFY(readByteToBuffer(), == true); 	// we must read this byte
-		char c = '0';
-		VERIFY(readByteToBuffer(), == true);
+		uint8_t link = 0;
+		if (_mux) {
+			VERIFY(readByteToBuffer(), == true); 	// we must read this byte
+			link = bufferTail() - '0';
+			VERIFY(readByteToBuffer(), == true);
+		}
+		// read until we have ":", or end of line
 		uint16_t currPos = bufferHead;
 		do {
 			VERIFY(readByteToBuffer(), == true);
-		} while (bufferTail() != ':');
-		_tcpDataSize = atoi(esp8266RxBuffer+currPos);
-		
-		// if we are waiting for command response we should discard tcp data (WARNING)
-		if (discardTcpData || c != '0') {
-			drainTcpData();
+		} while (bufferTail() != ':' && bufferTail() != '\n');
+		uint16_t size = atoi(esp8266RxBuffer+currPos);
+#if ESP8266_ENABLE_STATS
+		_stats.ipdFrames++;
+#endif
+		if (bufferTail() == '\n') {
+			// payload stays with ESP8266
+			if (link < ESP8266_MAX_SOCK_NUM) {
+#if ESP8266_ENABLE_PASSIVE_RECV
+				// a guess until CIPRECVLEN? tells exactly
+				_links[link].rxHeld += size;
+				_recvLenStale = true;
+#endif
+				dispatchEvent(ESP8266_EVENT_IPD, link, size);
+			}
 		} else {
-			DEBUG_VERBOSE(Serial.print(F("IPD size:")));
-			DEBUG_VERBOSE(Serial.println(_tcpDataSize));
+			_tcpDataSize = size;
+			_tcpDataLink = link;
+			if (link >= ESP8266_MAX_SOCK_NUM) {
+				skipTcpData();
+#if ESP8266_ENABLE_UDP
+			} else if (_links[link].state == ESP8266_TCP_UDP && !udpHeader(link, currPos)) {
+				skipTcpData();
+#endif
+			} else {
+				DEBUG_VERBOSE(Serial.print(F("IPD size:")));
+				DEBUG_VERBOSE(Serial.println(_tcpDataSize));
+				absorbTcpData();
+				// if we are waiting for command response, whatever does not fit
+				// into the ring has to go (WARNING)
+				if (discardTcpData) drainTcpData();
+				dispatchEvent(ESP8266_EVENT_IPD, link, size);
+			}
 		}
 	}
 	
-	if (flag) {
-		clearBuffer();
-	}
-	return flag;
+	clearBuffer();
+	_matcher.restart();
 }
  
-void Esp8266::drainTcpData()
+#if ESP8266_ENABLE_UDP
+// +IPD,<link>,<len>,<ip>,<port>: ; pos is where <len> starts in rx buffer.
+// Put header in front of the datagram in the link's ring, if all of it fits
+bool Esp8266::udpHeader(uint8_t link, uint16_t pos)
+{
+	esp8266_link & l = _links[link];
+	if (ESP8266_LINK_RX_BUFFER_LEN - l.rxCount < ESP8266_UDP_HEADER_LEN + _tcpDataSize) {
+		DEBUG(Serial.print(F("\nWARNING : UDP datagram does not fit (bytes) : ")));
+		DEBUG(Serial.println(_tcpDataSize));
+		return false;
+	}
+	
+	uint8_t h[ESP8266_UDP_HEADER_LEN] = { (uint8_t)_tcpDataSize, (uint8_t)(_tcpDataSize >> 8) };
+	char * p = strchr(esp8266RxBuffer + pos, ',');
+	for (uint8_t i = 0; p && i < 4; i++) {
+		h[2 + i] = atoi(p + 1);
+		p = strchr(p + 1, i < 3 ? '.' : ',');
+	}
+	if (p) {
+		uint16_t port = atoi(p + 1);
+		h[6] = port;
+		h[7] = port >> 8;
+	}
+	
+	uint16_t tail = (l.rxHead + l.rxCount) % ESP8266_LINK_RX_BUFFER_LEN;
+	for (uint8_t i = 0; i < ESP8266_UDP_HEADER_LEN; i++) {
+		esp8266LinkRxBuffer[link][tail] = h[i];
+		if (++tail == ESP8266_LINK_RX_BUFFER_LEN) tail = 0;
+	}
+	l.rxCount += ESP8266_UDP_HEADER_LEN;
+	return true;
+}
+#endif
+
+#if ESP8266_ENABLE_PASSIVE_RECV
+// one command at a time, as long as no other is queued: bring the counts
+// up to date after +IPD announcements, then fetch for a link whose ring
+// has room
+void Esp8266::queueRecv()
+{
+	if (_recvLenStale) {
+		queueCommand(ESP8266_OP_RECV_LEN, ignoreResult);
+		return;
+	}
+	
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++) {
+		esp8266_link & l = _links[link];
+		if (l.rxHeld == 0) continue;
+		uint16_t room = ESP8266_LINK_RX_BUFFER_LEN - l.rxCount;
+		// rather than a trickle of small fetches, wait for half a ring
+		if (room < l.rxHeld && room < ESP8266_LINK_RX_BUFFER_LEN / 2) continue;
+		
+		esp8266_handle h = queueCommand(ESP8266_OP_RECV_DATA, ignoreResult);
+		if (h >= 0) {
+			_cmds[h].link = link;
+			_cmds[h].num = min(room, l.rxHeld);
+		}
+		return;
+	}
+}
+
+// +CIPRECVDATA,<len>:<payload> (AT 2.x: +CIPRECVDATA:<len>,<payload>)
+// answering our fetch; payload goes into the ring like +IPD payload, and
+// fits as we asked for no more than that
+void Esp8266::recvData()
+{
+	ASSERT(_tcpDataSize == 0);
+	
+	VERIFY(readByteToBuffer(), == true);	// separator
+	uint16_t currPos = bufferHead;
+	do {
+		VERIFY(readByteToBuffer(), == true);
+	} while (isdigit(bufferTail()));
+	_tcpDataSize = atoi(esp8266RxBuffer+currPos);
+	
+	if (_cmdActive < 0 || _cmds[_cmdActive].op != ESP8266_OP_RECV_DATA) {
+		skipTcpData();		// not asked for by us
+		return;
+	}
+	esp8266_cmd & cmd = _cmds[_cmdActive];
+	cmd.sent = _tcpDataSize;
+	_tcpDataLink = cmd.link;
+	// no longer held; counted as pending payload from here on
+	esp8266_link & l = _links[cmd.link];
+	l.rxHeld -= min(l.rxHeld, _tcpDataSize);
+	drainTcpData();
+}
+
+// +CIPRECVLEN:<len of link 0>,<link 1>,...
+int16_t Esp8266::parseRecvLen(int16_t rsp)
 {
+	// old firmware; keep going by the +IPD announcements
+	if (rsp < 0) return rsp;
+	
+	char * p = searchBuffer(ESP8266_RECV_LEN);
+	if (p == NULL) return ESP8266_RSP_UNKNOWN;
+	p += strlen_P(ESP8266_RECV_LEN);
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM && p; link++) {
+		_links[link].rxHeld = atoi(p + 1);
+		p = strchr(p + 1, ',');
+	}
+	return rsp;
+}
+#endif
+
+// move pending +IPD payload from serial into the link's rx ring, as long
+// as it fits; the rest stays in serial buffer until the ring is read
+void Esp8266::absorbTcpData()
+{
+	if (_passthrough) {
+		// everything is payload of link 0, no framing
+		esp8266_link & l = _links[0];
+		uint16_t tail = (l.rxHead + l.rxCount) % ESP8266_LINK_RX_BUFFER_LEN;
+		bool ok = !rxOverflow();	// counts it, whatever the debug level
+		WARN(ok);
+		while (l.rxCount < ESP8266_LINK_RX_BUFFER_LEN && _serial.available()) {
+			esp8266LinkRxBuffer[0][tail] = _serial.read();
+			if (++tail == ESP8266_LINK_RX_BUFFER_LEN) tail = 0;
+			l.rxCount++;
+#if ESP8266_ENABLE_STATS
+			_stats.tcpRxBytes++;
+#endif
+		}
+		return;
+	}
+	
 	if (_tcpDataSize == 0) return;
 	
-	Serial.print(F("\nWARNING : discarding TCP data (bytes) : "));
-	Serial.println(_tcpDataSize);
+	esp8266_link & l = _links[_tcpDataLink];
+	uint8_t * ring = esp8266LinkRxBuffer[_tcpDataLink];
+	uint16_t tail = (l.rxHead + l.rxCount) % ESP8266_LINK_RX_BUFFER_LEN;
+	_lastRxMicros = micros();
+	for (; _tcpDataSize > 0 && l.rxCount < ESP8266_LINK_RX_BUFFER_LEN; _tcpDataSize--) {
+		bool ok = !rxOverflow();
+		WARN(ok);
+		// rest of the frame is not coming (module reset, bytes lost); 
+		// skipTcpData() counts it as discarded and gives up as well
+		if (!waitForByte()) {
+			skipTcpData();
+			return;
+		}
+		ring[tail] = _serial.read();
+		DEBUG_VERBOSE_RX(Serial.write(ring[tail]));
+		if (++tail == ESP8266_LINK_RX_BUFFER_LEN) tail = 0;
+		l.rxCount++;
+#if ESP8266_ENABLE_STATS
+		_stats.tcpRxBytes++;
+#endif
+	}
+	_lastRxMicros = micros();
+}
+
+// discard pending +IPD payload that did not fit into the rx ring
+void Esp8266::drainTcpData()
+{
+	absorbTcpData();
+	if (_tcpDataSize == 0) return;
 	
+	DEBUG(Serial.print(F("\nWARNING : discarding TCP data (bytes) : ")));
+	DEBUG(Serial.println(_tcpDataSize));
+	skipTcpData();
+}
+
+void Esp8266::skipTcpData()
+{
+#if ESP8266_ENABLE_STATS
+	_stats.discardedBytes += _tcpDataSize;
+#endif
+	if (_tcpDataSize > 0) ESP8266_TRACE(ESP8266_TRACE_DISCARD, _tcpDataLink, _tcpDataSize);
+	_lastRxMicros = micros();
 	for (; _tcpDataSize > 0; _tcpDataSize--) {
-		ASSERT(!_serial->overflow());
-		while (! _serial->available());
-		uint8_t c = _serial->read();
-		DEBUG_VERBOSE(Serial.write(c));
+		bool ok = !rxOverflow();
+		WARN(ok);
+		if (!waitForByte()) {
+			// frame cut short; whatever follows is parsed as responses
+			WARN(false);
+			if (_rxErrors < 255) _rxErrors++;
+			_tcpDataSize = 0;
+			break;
+		}
+		uint8_t c = _serial.read();
+		(void)c;		// only echoed at verbose debug
+		DEBUG_VERBOSE_RX(Serial.write(c));
 	}
+	_lastRxMicros = micros();
 }
 
 void Esp8266::drainAllData()
@@ -571,11 +2318,12 @@ void Esp8266::drainAllData()
 	drainTcpData();
 	
 	for (;;) {
-		ASSERT(!_serial->overflow());
-		if (!_serial->available()) delay(2);
-		if (!_serial->available()) return;
-		uint8_t c = _serial->read();
-		DEBUG_VERBOSE(Serial.write(c));
+		bool ok = !rxOverflow();
+		WARN(ok);
+		if (!waitForByte()) return;
+		uint8_t c = _serial.read();
+		(void)c;		// only echoed at verbose debug
+		DEBUG_VERBOSE_RX(Serial.write(c));
 	}	
 }
 
@@ -594,45 +2342,78 @@ void Esp8266::clearBuffer()
 	bufferHead = 0;
 }	
 
-bool Esp8266::readByteToBuffer()
+bool Esp8266::readByteToBuffer(bool wait)
 {
 	if (_tcpDataSize > 0)		// we only read cmd data
 		return false;
 
-	WARN(!_serial->overflow());
+	bool ok = !rxOverflow();
+	WARN(ok);
 	
-	// Read a byte in; extra is to make sure
-	// aggressive continuous reading will choke on slow UART
-	// This is important for reliable serial input processing
-	// 2ms delay is good enough to cover 9600 speed
-	// in theory 1ms should be sufficient, but in practice we have
-	// seen it is not good enough
-	if (!_serial->available()) delay(2);
+	if (wait) {
+		if (!waitForByte()) return false;
+	} else {
+		if (!_serial.available()) return false;
+		_lastRxMicros = micros();
+	}
 	
-	if (!_serial->available()) return false;
+	char c = _serial.read();
+	DEBUG_VERBOSE_RX(Serial.write(c));
 	
-	char c = _serial->read();
-	DEBUG_VERBOSE(Serial.write(c));
+	// a runaway line (e.g. noise at a wrong baud rate) starts over rather
+	// than running off the buffer
+	if (bufferHead >= ESP8266_RX_BUFFER_LEN - 1) {
+		WARN(false);
+		if (_rxErrors < 255) _rxErrors++;
+		bufferHead = 0;
+	}
 	
 	// Store the data in the buffer
 	esp8266RxBuffer[bufferHead++] = c;
-	ASSERT(bufferHead < ESP8266_RX_BUFFER_LEN);
 	esp8266RxBuffer[bufferHead] = 0;
 	return true;
 }
 
-char * Esp8266::searchBuffer(const char * test)
+// Aggressive continuous reading would otherwise take a momentarily empty
+// UART for the end of a burst.  We keep waiting while the line has been
+// quiet for less than _rxGapMicros since the last byte (a few character
+// times at current baud rate).  An idle line returns at once, so polling
+// costs microseconds instead of a fixed delay.
+bool Esp8266::waitForByte()
+{
+	while (!_serial.available()) {
+		if ((unsigned long)(micros() - _lastRxMicros) >= _rxGapMicros)
+			return false;
+	}
+	_lastRxMicros = micros();
+	return true;
+}
+
+// reading the flag clears it
+bool Esp8266::rxOverflow()
+{
+	if (!_serial.overflow()) return false;
+	if (_rxErrors < 255) _rxErrors++;
+#if ESP8266_ENABLE_STATS
+	_stats.overflows++;
+#endif
+	ESP8266_TRACE(ESP8266_TRACE_OVERFLOW, 0, 0);
+	return true;
+}
+
+char * Esp8266::searchBuffer(PGM_P test)
 {
-	return strstr((const char *)esp8266RxBuffer, test);
+	return strstr_P(esp8266RxBuffer, test);
 }
 
+#if ESP8266_ENABLE_RAW_TEST
 void Esp8266::rawTest(const char *cmd, uint16_t timeout)
 {
-	_serial->println(cmd);
+	_serial.println(cmd);
 	unsigned long timeIn = millis();	// Timestamp coming into function
 	do {
-		if (_serial->available())
-			Serial.write(_serial->read());
+		if (_serial.available())
+			Serial.write(_serial.read());
 	} while (millis() < timeIn + timeout);
 }
-
+#endif
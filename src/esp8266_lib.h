@@ -6,30 +6,52 @@ Original Creation Date: June 20, 2015
 http://github.com/sparkfun/SparkFun_ESP8266_AT_Arduino_Library
 
 
-TCP states:
-		- by default TCP is not up (TCP_NONE)
-		- at this point we can start either a server (tcpServerStart()) or a client(tcpConnect())
-		- one cannot start server if TCP is in client mode; vice versa;
-		- when in TCP_SERVER state, one calls tcpServerStop() to tear it down
-		- when in TCP_CLIENT state, TCP goes back to TCP_NONE when connection is down 
-		  either disconnected by server or actively cancelled by calling tcpClose()
-		- when connected, use tcpReceive()/tcpSend() to read/write with remote machine
+TCP links:
+		- ESP8266 runs in multiple connection mode (CIPMUX=1) with up to
+		  ESP8266_MAX_SOCK_NUM links; each link has its own state in _links[]
+		- a link is either free (ESP8266_TCP_NONE), opened by us as a client
+		  (ESP8266_TCP_CLIENT, see tcpConnect()) or accepted by our server
+		  (ESP8266_TCP_SERVER, see tcpServerStart())
+		- a link goes back to ESP8266_TCP_NONE when connection is down, 
+		  either disconnected by remote or actively cancelled by calling tcpClose()
+		- use getFreeLink() to pick an id for a new client connection
+		- when connected, use tcpRead()/tcpWrite() to read/write with remote machine
+		- received payload is kept in a per link ring (ESP8266_LINK_RX_BUFFER_LEN)
+		  so it survives AT commands issued in between; it stays readable
+		  after remote closes the link.  Only what fits, though: a +IPD
+		  frame carries up to 1460 bytes, and once a ring is full the rest
+		  of the frame waits in the serial buffer, holding up all input,
+		  and is discarded by the next command (getStats().discardedBytes).
+		  Where commands run while data comes in, use passive receive or
+		  a ring as big as the largest frame.
+		- calls without link id operate on link 0
+		- with tcpPassiveRecv(true), ESP8266 keeps the payload and we fetch
+		  it when there is room in the ring (see below)
+		- tcpPassthroughStart() opens a single client connection in 
+		  transparent mode (CIPMODE=1) instead; until tcpPassthroughStop(),
+		  link 0 carries raw bytes both ways and no AT command can be issued
 		
 	Separate convenience classes are provided to provide server or client functionalities
 	that are compatible with other Arduino networking libraries
 
 ESP8266 has 3 kinds of async input over serial that are interesting to us:
 
- 1. 0,CONNECT - only happens in TCP_SERVER mode. A new client joins.
-    A variation is 1,CONNECT (or 2,CONNECT) where we need to forcefully disconnect
- 2. 0,CLOSE - TCP session terminates; both server mode and client mode
- 3. +IPD,.... - input data; both server and client modes; when connected.
+ 1. <link>,CONNECT - a new client joins our server, or our client connection is up
+ 2. <link>,CLOSED - TCP session terminates; both server mode and client mode
+ 3. +IPD,<link>,.... - input data; both server and client modes; when connected.
+
+Those, together with WIFI DISCONNECT, WIFI GOT IP, busy p... and SEND OK/FAIL,
+are turned into typed events (esp8266_event_type).  Sketches can register a 
+handler per event type with onEvent() and call poll() from loop().
 
 There two cases we need to check for aysnc input:
   1. after sending commands and checking for cmd responses
   2. check for TCP data or client connection.
   
-For #2, we use readForAsync().  For #1, we have readForResponse() and readForResponses()
+Both go through poll(), which also drives the command engine: every command
+is queued and answered by poll() step by step, without blocking.  The 
+xxxAsync() calls return a handle right away; the classic blocking calls
+queue the same command and poll() until it completes.
 
 ******************************************************************************/
 
@@ -37,9 +59,12 @@ For #2, we use readForAsync().  For #1, we have readForResponse() and readForRes
 #define __esp8266_lib_h__
 
 #include <Arduino.h>
-#include <SoftwareSerial.h>
 #include <IPAddress.h>
 
+#include "esp8266_config.h"
+#include "esp8266_matcher.h"
+#include "esp8266_transport.h"
+
 
 ///////////////////////////////
 // Command Response Timeouts //
@@ -49,11 +74,16 @@ For #2, we use readForAsync().  For #1, we have readForResponse() and readForRes
 #define WIFI_CONNECT_TIMEOUT 30000
 #define COMMAND_RESET_TIMEOUT 5000
 #define CLIENT_CONNECT_TIMEOUT 5000
+#define PASSTHROUGH_ESCAPE_GAP 50		// quiet time before "+++" so it is a packet of its own
+#define PASSTHROUGH_EXIT_TIMEOUT 1000	// after "+++" before ESP8266 takes AT commands again
 
-#define ESP8266_MAX_SOCK_NUM 5
 #define ESP8266_SOCK_NOT_AVAIL 255
 
+// most ESP8266 takes in one CIPSEND; longer writes are split into chunks
+#define ESP8266_MAX_SEND_LEN 2048
+
 enum esp8266_cmd_rsp {
+	ESP8266_RSP_PENDING = -6,	// async command not completed yet; not an error
 	ESP8266_CMD_BAD = -5,
 	ESP8266_RSP_MEMORY_ERR = -4,
 	ESP8266_RSP_FAIL = -3,
@@ -88,13 +118,106 @@ enum esp8266_connect_status {
 	ESP8266_STATUS_NOWIFI = 5	
 };
 
-// current state of TCP connection
+// current state of a TCP link
 enum esp8266_tcp_state {
 	ESP8266_TCP_NONE,
 	ESP8266_TCP_SERVER,
-	ESP8266_TCP_CLIENT
+	ESP8266_TCP_CLIENT,
+	ESP8266_TCP_UDP		// not TCP at all; see udpOpen()
+};
+
+// in front of every datagram in a UDP link's rx ring: length (2 bytes),
+// sender IP (4), sender port (2)
+#define ESP8266_UDP_HEADER_LEN 8
+
+// async messages (URCs) reported to handlers registered with onEvent()
+enum esp8266_event_type {
+	ESP8266_EVENT_CONNECT,			// <link>,CONNECT
+	ESP8266_EVENT_CLOSED,			// <link>,CLOSED
+	ESP8266_EVENT_IPD,				// +IPD,<link>,<length>: data is ready to read
+	ESP8266_EVENT_WIFI_DISCONNECT,	// WIFI DISCONNECT
+	ESP8266_EVENT_WIFI_GOT_IP,		// WIFI GOT IP
+	ESP8266_EVENT_BUSY,				// busy p... / busy s...
+	ESP8266_EVENT_SEND_OK,			// SEND OK
+	ESP8266_EVENT_SEND_FAIL,		// SEND FAIL
+	ESP8266_EVENT_NUM
+};
+
+struct esp8266_event {
+	esp8266_event_type type;
+	uint8_t link;		// ESP8266_SOCK_NOT_AVAIL if event is not link specific
+	uint16_t length;	// ESP8266_EVENT_IPD only
 };
 
+// handlers run inside the library's receive loop, so they should be short
+// and must not call back into Esp8266 (e.g. issue AT commands or read data)
+typedef void (*esp8266_event_handler)(const esp8266_event * event);
+
+#if ESP8266_ENABLE_FAST_JOIN
+// what connectAPFast() goes by; plain bytes, to be kept e.g. in EEPROM
+struct esp8266_join_cache {
+	uint8_t bssid[6];		// AP joined last; all 0: unknown
+	uint8_t channel;		// its channel, for information only (see connectAPFast())
+	uint8_t ip[4];			// 0.0.0.0: DHCP
+	uint8_t gateway[4];
+	uint8_t netmask[4];
+};
+#endif
+
+// one segment of a vectored write, see tcpWritev()
+struct esp8266_iovec {
+	const uint8_t * buf;
+	size_t len;
+	bool progmem;		// buf is in flash (PROGMEM)
+};
+
+// handle of a queued command; <0 (esp8266_cmd_rsp) if it could not be queued
+typedef int8_t esp8266_handle;
+
+// called from poll() when command completes, with the same result the
+// blocking call would return; may queue further commands but must not make
+// blocking calls
+typedef void (*esp8266_cmd_handler)(esp8266_handle handle, int16_t result);
+
+#if ESP8266_ENABLE_STATS
+// what commands are counted and timed under in esp8266_stats
+enum esp8266_cmd_class {
+	ESP8266_CLASS_CONTROL,	// AT, ATE, AT+GMR, mode and baud rate settings
+	ESP8266_CLASS_WIFI,		// joining and leaving AP, AP/IP/MAC queries
+	ESP8266_CLASS_LINK,		// opening and closing links, server on/off, DNS
+	ESP8266_CLASS_SEND,		// CIPSEND, from command to last SEND OK
+	ESP8266_CLASS_RECV,		// passive receive fetches and length queries
+	ESP8266_CLASS_PING,
+	ESP8266_CLASS_NUM
+};
+
+struct esp8266_cmd_stats {
+	uint16_t count;			// completed, successful or not
+	uint16_t failed;		// ERROR, FAIL etc.
+	uint16_t timeouts;		// ESP8266_RSP_TIMEOUT
+	uint16_t unknown;		// ESP8266_RSP_UNKNOWN, i.e. garbled
+	// response latency, from sending command to its final answer;
+	// average is totalMicros / count
+	uint32_t minMicros;
+	uint32_t maxMicros;
+	uint32_t totalMicros;
+};
+
+struct esp8266_stats {
+	uint32_t rxBytes;			// serial bytes from ESP8266
+	uint32_t txBytes;			// serial bytes to ESP8266
+	uint32_t tcpRxBytes;		// payload taken into link rx rings
+	uint32_t tcpTxBytes;		// payload acknowledged by SEND OK (or passed through)
+	uint32_t ipdFrames;			// +IPD frames, incl. passive receive announcements
+	uint32_t discardedBytes;	// payload dropped, e.g. ring full during a command
+	uint16_t overflows;			// serial port reported lost bytes
+	esp8266_cmd_stats cmds[ESP8266_CLASS_NUM];
+};
+#endif
+
+// begin() was given a rate outside the table; it is left alone
+#define ESP8266_BAUD_CUSTOM 255
+
 // general rules about return value
 //  == 0: successful
 //  >0 : sucessful with N chars read in buffer
@@ -102,14 +225,33 @@ enum esp8266_tcp_state {
 class Esp8266
 {
 public:
+	// see esp8266_transport.h
+#if ESP8266_SOFTWARE_SERIAL
 	Esp8266(SoftwareSerial* swSerial);
+#endif
+	Esp8266(HardwareSerial* hwSerial);
+	Esp8266(Stream* stream, const esp8266_transport_hooks * hooks = NULL);
 	
-	int16_t begin(unsigned long baudRate = 9600);
+	/*
+	  baudRate is what ESP8266 is expected to run at.  With maxBaud set:
+		- if it does not answer there, the other standard rates are tried
+		- then it is switched (AT+UART_CUR, not saved) to the highest rate
+		  up to maxBaud that passes a verification burst
+		- later on, if receive errors pile up, poll() steps the rate down
+		  again, but never below the rate found at begin()
+	  maxBaud should not exceed what the serial port sustains, e.g. 57600
+	  for SoftwareSerial on a 16MHz AVR.  A plain Stream needs a begin hook
+	  for any of this.
+	*/
+	int16_t begin(unsigned long baudRate = 9600, unsigned long maxBaud = 0);
+	unsigned long baudRate();		// current rate
 	
 	///////////////////////
 	// Basic AT Commands //
 	///////////////////////
+#if ESP8266_ENABLE_VERSION
 	int16_t getVersion(char * ATversion, char * SDKversion, char * compileTime);
+#endif
 	
 	////////////////////
 	// WiFi Functions //
@@ -120,43 +262,334 @@ public:
 	int16_t getLocalMAC(char * mac);
 	int16_t getLocalIP(IPAddress& ip);
 	int16_t disconnectAP();
+	// joined and got an address, as far as ESP8266 has told us since begin()
+	bool wifiConnected() { return _wifiUp; }
+	esp8266_handle connectAPAsync(const char * ssid, const char * pwd, esp8266_cmd_handler handler = NULL);
+	esp8266_handle disconnectAPAsync(esp8266_cmd_handler handler = NULL);
+	
+#if ESP8266_ENABLE_FAST_JOIN
+	/*
+	  fast join
+	  connectAPFast() joins like connectAP() but skips what it can.  With a
+	  static address set, it applies it first (AT+CIPSTA_CUR), so the join
+	  does without DHCP.  Once an AP has been joined, its BSSID is kept and
+	  given to later joins, which then go to that AP only; should that 
+	  fail, the BSSID is forgotten and the ssid joined wherever it is.
+	  AT firmware 1.x takes no channel, so the one kept is only reported.
+	  joinCache() is all there is to keep across power cycles.
+	  joinMillis() is how long the last join (of either kind) took, from
+	  its first command to OK.
+	*/
+	int16_t connectAPFast(const char * ssid, const char * pwd);
+	esp8266_handle connectAPFastAsync(const char * ssid, const char * pwd, esp8266_cmd_handler handler = NULL);
+	// all 0.0.0.0: back to DHCP with the next connectAPFast()
+	void setStaticIP(IPAddress ip, IPAddress gateway, IPAddress netmask);
+	esp8266_join_cache & joinCache() { return _join; }
+	unsigned long joinMillis() { return _joinMillis; }
+#endif
 	
 	/*
 	  TCP stuff
 	*/
+#if ESP8266_ENABLE_SERVER
 	int16_t tcpServerStart(uint16_t port);
 	int16_t tcpServerStop();
+	// connections to our server are queued as they come in; this returns
+	// the oldest one not handed out yet (each only once), 
+	// ESP8266_SOCK_NOT_AVAIL if none.  One closed by remote before it was
+	// accepted is still handed out if data it sent is waiting.
+	uint8_t tcpAccept();
+#endif
+	uint8_t getFreeLink();	// ESP8266_SOCK_NOT_AVAIL if all links are busy
+	esp8266_tcp_state tcpState(uint8_t link) { return _links[link].state; }
+	
 	int16_t tcpConnect(const char * destination, uint16_t port, uint16_t keepAlive);
+	int16_t tcpConnect(uint8_t link, const char * destination, uint16_t port, uint16_t keepAlive);
+	esp8266_handle tcpConnectAsync(uint8_t link, const char * destination, uint16_t port, uint16_t keepAlive, esp8266_cmd_handler handler = NULL);
 	int16_t tcpClose();
+	int16_t tcpClose(uint8_t link);
+	esp8266_handle tcpCloseAsync(uint8_t link, esp8266_cmd_handler handler = NULL);
 	bool tcpConnected();	// for both server and client connection
+	bool tcpConnected(uint8_t link);
+	
+#if ESP8266_ENABLE_POOL
+	/*
+	  connection pool
+	  tcpPark() keeps a link we connected for reuse instead of closing it;
+	  false (nothing done) if it is not up or has unread data.
+	  tcpReuse() takes a parked link to the same host and port (as given to
+	  tcpConnect()) out of the pool again, ESP8266_SOCK_NOT_AVAIL if none.
+	  A parked link closed by remote leaves the pool with its CLOSED, one
+	  that received data in the meantime is closed rather than reused, and
+	  one idle for ESP8266_POOL_IDLE_TIMEOUT is closed on the next call.
+	  When links run out, tcpEvict() closes the one parked the longest and
+	  returns getFreeLink().  Esp8266Client does all of this by itself
+	  after setPooling(true).
+	*/
+	bool tcpPark(uint8_t link);
+	uint8_t tcpReuse(const char * host, uint16_t port);
+	uint8_t tcpEvict();
+	void tcpPoolClose();	// close all parked links
+#endif
 
 	int16_t tcpWrite(const char* msg);
+	int16_t tcpWrite(uint8_t link, const char* msg);
 	int16_t tcpWrite(const uint8_t *buf, size_t size);
-	int16_t tcpRead(uint8_t *buf, size_t size);  // return size received; no waiting; <0 indicates error
+	int16_t tcpWrite(uint8_t link, const uint8_t *buf, size_t size);
+	esp8266_handle tcpWriteAsync(uint8_t link, const uint8_t *buf, size_t size, esp8266_cmd_handler handler = NULL);
+	// gather iovcnt segments into the same CIPSEND frame(s) without copying;
+	// any total length, sent in chunks of ESP8266_MAX_SEND_LEN.  Returns 
+	// bytes sent, which is less than requested if a later chunk failed.
+	// Segments marked progmem are read from flash as they go out.
+	int32_t tcpWritev(uint8_t link, const esp8266_iovec * iov, uint8_t iovcnt);
+	esp8266_handle tcpWritevAsync(uint8_t link, const esp8266_iovec * iov, uint8_t iovcnt, esp8266_cmd_handler handler = NULL);
+	int16_t tcpRead(uint8_t *buf, size_t size);  // return size received; <0 indicates error; see tcpPassiveRecv() for waiting
+	int16_t tcpRead(uint8_t link, uint8_t *buf, size_t size);
 	uint8_t tcpRead();
+	uint8_t tcpRead(uint8_t link);
 	int tcpPeek();		// return -1 is none is available
+	int tcpPeek(uint8_t link);
 	int tcpAvailable();	// tcp data available for read in bytes
+	int tcpAvailable(uint8_t link);
+	
+	/*
+	  transparent transmission (CIPMODE=1) for bulk transfers
+	  only possible when no other link or server is active.  Saves the
+	  CIPSEND/SEND OK round trip of every write; tcpWrite()/tcpRead() etc. on
+	  link 0 move raw bytes.  Stop closes the connection (unread data is
+	  dropped like tcpClose() does) and goes back to multiple connections.
+	  tcpClose(0) also stops it.  Both calls block; stopping takes over a
+	  second due to the "+++" escape timing.
+	*/
+	int16_t tcpPassthroughStart(const char * destination, uint16_t port, uint16_t keepAlive = 0);
+	int16_t tcpPassthroughStop();
+	bool tcpPassthrough() { return _passthrough; }
+	
+#if ESP8266_ENABLE_PASSIVE_RECV
+	/*
+	  passive receive (AT+CIPRECVMODE=1, AT firmware 1.5 and later)
+	  ESP8266 keeps TCP payload and only announces it with +IPD,<link>,<len>;
+	  remote is held off by TCP flow control once its buffer is full.  
+	  poll() pulls the payload with AT+CIPRECVDATA, never more than fits 
+	  the link's rx ring, so nothing arrives faster than we take it and
+	  a download comes through intact at any baud rate.  Counts are kept
+	  exact with AT+CIPRECVLEN?, so tcpAvailable() includes what ESP8266
+	  still holds, and tcpRead()/tcpPeek() wait for one fetch when the
+	  ring is empty; tcpRead() returns what that brought rather than
+	  fetching again.  UDP links are not affected.  Not with passthrough.
+	*/
+	int16_t tcpPassiveRecv(bool enable);
+	bool tcpPassiveRecv() { return _passiveRecv; }
+#endif
 	
+#if ESP8266_ENABLE_UDP
+	/*
+	  UDP links
+	  udpOpen() sends to remote:remotePort by default.  With localPort it
+	  also listens there, and with mode 2 default remote becomes whoever
+	  sent the last datagram.  Datagrams are kept whole in the link's rx
+	  ring behind an ESP8266_UDP_HEADER_LEN header; one that does not fit
+	  the free space is dropped.  udpParse() moves on to the next datagram
+	  (skipping what is left of the current one) and returns its length;
+	  tcpAvailable()/tcpRead()/tcpPeek() then stay within it.  tcpClose()
+	  closes the link.
+	*/
+	int16_t udpOpen(uint8_t link, const char * remote, uint16_t remotePort, uint16_t localPort = 0, uint8_t mode = 0);
+	esp8266_handle udpOpenAsync(uint8_t link, const char * remote, uint16_t remotePort, uint16_t localPort = 0, uint8_t mode = 0, esp8266_cmd_handler handler = NULL);
+	// one datagram, at most ESP8266_MAX_SEND_LEN; remote NULL: default remote
+	int16_t udpWrite(uint8_t link, const uint8_t * buf, size_t size, const char * remote = NULL, uint16_t remotePort = 0);
+	esp8266_handle udpWriteAsync(uint8_t link, const uint8_t * buf, size_t size, const char * remote = NULL, uint16_t remotePort = 0, esp8266_cmd_handler handler = NULL);
+	int16_t udpParse(uint8_t link, IPAddress & remote, uint16_t & remotePort);	// 0: none
+#endif
+	
+#if ESP8266_ENABLE_DNS_CACHE
+	/*
+	  DNS cache
+	  tcpConnect() (and so Esp8266Client::connect()) with a host name first
+	  looks it up with AT+CIPDOMAIN and connects to the address; that is
+	  kept for ESP8266_DNS_TTL ms, so reconnects skip the lookup.  A name
+	  that did not resolve fails right away for ESP8266_DNS_FAIL_TTL ms.
+	  A failed connect drops the name, in case the address has moved.
+	  Names are only kept as a 32 bit hash, case folded; dotted quads are
+	  used as they are.
+	*/
+	int16_t resolve(const char * host, IPAddress & ip);
+	void dnsFlush();
+#endif
+	
+#if ESP8266_ENABLE_PING
 	int16_t ping(IPAddress ip);
-	int16_t ping(char * server);
+	int16_t ping(const char * server);
+	esp8266_handle pingAsync(const char * server, esp8266_cmd_handler handler = NULL);
+#endif
 	
+	/*
+	  non-blocking commands
+	  xxxAsync() queues a command and returns its handle; strings and buffers
+	  passed in must stay valid until it completes.  Without a handler, 
+	  cmdResult() returns ESP8266_RSP_PENDING until it is done, then the 
+	  result (and the handle is released).
+	*/
+	int16_t cmdResult(esp8266_handle handle);
+	bool cmdBusy();		// any command queued or in flight
+	
+	/*
+	  async messages
+	  poll() advances queued commands, processes pending input and fires
+	  event handlers; handlers also fire during any other call that reads
+	  from ESP8266.  It never waits for input.
+	*/
+	void poll();
+	void onEvent(esp8266_event_type type, esp8266_event_handler handler);	// NULL to remove
+	
+#if ESP8266_ENABLE_STATS
+	// counters since begin or last resetStats(); they wrap, so take
+	// differences of consecutive snapshots rather than absolute values
+	const esp8266_stats & getStats();
+	void resetStats();
+#endif
+	
+#if ESP8266_ENABLE_RAW_TEST
 	void rawTest(const char* cmd, uint16_t timeout_ms);	// send cmd over serial and display response for timeout_ms ms
+#endif
 
 private:
 	
+	// numbers show up in traces (see esp8266_trace_decode); add at the end
+	enum esp8266_op {
+		ESP8266_OP_NONE,
+		ESP8266_OP_TEST,
+		ESP8266_OP_ECHO,
+		ESP8266_OP_MUX,
+		ESP8266_OP_VERSION,
+		ESP8266_OP_CONNECT_AP,
+		ESP8266_OP_GET_AP,
+		ESP8266_OP_DISCONNECT_AP,
+		ESP8266_OP_GET_IP,
+		ESP8266_OP_GET_MAC,
+		ESP8266_OP_TCP_CONNECT,
+		ESP8266_OP_TCP_SEND,
+		ESP8266_OP_TCP_CLOSE,
+		ESP8266_OP_SERVER,
+		ESP8266_OP_PING,
+		ESP8266_OP_CIPMODE,
+		ESP8266_OP_PASSTHROUGH,
+		ESP8266_OP_UART,
+		ESP8266_OP_UDP_OPEN,
+		ESP8266_OP_RECV_MODE,
+		ESP8266_OP_RECV_DATA,
+		ESP8266_OP_RECV_LEN,
+		ESP8266_OP_DOMAIN
+	};
+	
+	enum esp8266_cmd_state {
+		ESP8266_CMD_FREE,
+		ESP8266_CMD_QUEUED,
+		ESP8266_CMD_SENT,	// waiting for response
+		ESP8266_CMD_DATA,	// CIPSEND chunk written, waiting for SEND OK
+		ESP8266_CMD_DONE	// result not collected yet
+	};
+	
+	struct esp8266_cmd {
+		uint8_t op;				// esp8266_op
+		uint8_t state;			// esp8266_cmd_state
+		uint8_t link;
+		uint16_t num;			// port, chunk size, on/off, bytes to fetch
+		uint16_t num2;			// keep alive, UDP remote port
+		uint16_t num3;			// UDP local port
+		uint8_t mode;			// UDP mode; TCP connect: host name being looked up; join: JOIN_xxx steps
+		const char * str;		// ssid, destination, ping target, UDP remote, host
+		const char * str2;		// password
+		// CIPSEND payload: segments, position of next chunk in them
+		const esp8266_iovec * iov;
+		esp8266_iovec one;		// iov of single buffer writes
+		uint8_t iovcnt;
+		uint8_t seg;
+		size_t segOff;
+		uint32_t left;			// bytes not sent yet
+		uint32_t sent;			// bytes acknowledged by SEND OK, or fetched
+		esp8266_cmd_handler handler;
+		int16_t result;
+#if ESP8266_ENABLE_STATS
+		unsigned long start;	// micros() when it went out
+#endif
+	};
+	
+	// command engine
+	esp8266_handle queueCommand(uint8_t op, esp8266_cmd_handler handler);
+	void waitForSlot();
+	int16_t runCommand(esp8266_handle h);
+	int16_t command(uint8_t op, uint16_t num = 0);
+	void issueCommand(esp8266_cmd & cmd);
+	void advanceCommand(int16_t result);
+	int16_t finishCommand(esp8266_cmd & cmd, int16_t result);
+#if ESP8266_ENABLE_STATS
+	void countCommand(esp8266_cmd & cmd, int16_t result);
+#endif
+#if ESP8266_ENABLE_PING
+	int16_t parsePing(int16_t rsp);
+#endif
+#if ESP8266_ENABLE_POOL
+	void expirePool();
+#endif
+#if ESP8266_ENABLE_DNS_CACHE
+	int16_t dnsLookup(const char * host, uint8_t * ip);
+	void dnsStore(const char * host, const uint8_t * ip);
+	void dnsForget(const char * host);
+	int16_t parseDomain(const char * host, int16_t rsp);
+#endif
+#if ESP8266_ENABLE_FAST_JOIN
+	bool staticIp();
+	bool joinStep(esp8266_cmd & cmd, int16_t & result);
+	void parseJoin();
+#endif
+	void writeChunk(esp8266_cmd & cmd);
+	void writeSegment(const esp8266_iovec & v, size_t off, size_t k);
+	void passthroughWait(unsigned int ms);
+	
+	void init();
+	
 	// helper commands
 	int16_t test();
 	int16_t setMux(uint8_t mux);
 	int16_t echo(bool enable);
+	
+	// baud rate handling
+	void setBaud(uint8_t index);
+	int16_t probeBaud();
+	int16_t upgradeBaud(unsigned long maxBaud);
+	int16_t verifyBaud(uint16_t length, uint16_t sum);
+	uint16_t bufferSum();
+	bool rxOverflow();
 
-	// low-level send/receive
-	void sendCommand(const char * cmd, enum esp8266_command_type type = ESP8266_CMD_EXECUTE, const char * params = NULL);
-	int16_t readForResponse(const char * rsp, unsigned int timeout);
-	int16_t readForResponses(const char * pass, const char * fail, unsigned int timeout);
-	int16_t readForAsync(unsigned int timeout);
-	bool checkAsyncMsg(bool discardTcpData);
-	void drainTcpData();		// discard unread TCP data
+	// low-level send/receive; commands and tokens are in PROGMEM.
+	// Parameters are streamed out one by one, no formatting buffer:
+	// beginCommand(), sendArg() per parameter, endCommand()
+	void sendCommand(PGM_P cmd, enum esp8266_command_type type = ESP8266_CMD_EXECUTE);
+	void beginCommand(PGM_P cmd, enum esp8266_command_type type);
+	void sendArg(unsigned long n);
+	void sendArg(const char * s);	// quoted
+	void sendArg_P(PGM_P s);		// quoted
+	void endCommand();
+	void startResponse(PGM_P pass, PGM_P fail, unsigned int timeout);
+	void endResponse();
+	int16_t stepResponse();
+	void resetLink(uint8_t link);
+	void handleAsyncMsg(uint16_t match, bool discardTcpData);
+	void dispatchEvent(esp8266_event_type type, uint8_t link, uint16_t length);
+	uint8_t linkBefore(PGM_P token);
+	void absorbTcpData();		// move pending TCP data (or passthrough bytes) into link rx ring
+	void drainTcpData();		// discard pending TCP data that does not fit the ring
+	void skipTcpData();			// discard all pending TCP data
+#if ESP8266_ENABLE_UDP
+	bool udpHeader(uint8_t link, uint16_t pos);
+#endif
 	void drainAllData();
+#if ESP8266_ENABLE_PASSIVE_RECV
+	void queueRecv();
+	void recvData();
+	int16_t parseRecvLen(int16_t rsp);
+#endif
 	
 	size_t write(const uint8_t * buf, size_t size);
 	
@@ -164,26 +597,90 @@ private:
 	void clearBuffer();
 	
 	// readByteToBuffer() - Read first byte from UART receive buffer
-	// and store it in rxBuffer. Delay 1ms for persistent reliable read.
+	// and store it in rxBuffer. If wait is set, wait up to inter-character
+	// gap for persistent reliable read.
 	// return false, if none avaiable to raed.
-	bool readByteToBuffer();
+	bool readByteToBuffer(bool wait = true);
+	
+	// true if a byte is available, waiting for it while we are within
+	// the inter-character gap of previous byte
+	bool waitForByte();
+	void setRxGap(unsigned long baudRate);
 	
-	/// searchBuffer([test]) - Search buffer for string [test]
+	/// searchBuffer([test]) - Search buffer for string [test] (in PROGMEM)
 	/// Success: Returns pointer to beginning of string
 	/// Fail: returns NULL
-	char * searchBuffer(const char * test);
+	char * searchBuffer(PGM_P test);
 	
 	// return last byte in rx buffer; return 0 otherwise
 	uint8_t bufferTail();
 	
 	// esp8266 states
-	SoftwareSerial * _serial;
-	esp8266_tcp_state _tcpState=ESP8266_TCP_NONE;
-	bool _tcpConnected=false;
+	Esp8266Transport _serial;
+	Esp8266Matcher _matcher;
+	esp8266_event_handler _eventHandlers[ESP8266_EVENT_NUM];
+	esp8266_cmd _cmds[ESP8266_CMD_QUEUE_LEN];
+	esp8266_handle _cmdFifo[ESP8266_CMD_QUEUE_LEN];	// queued commands, oldest first
+	uint8_t _cmdQueued=0;
+	esp8266_handle _cmdActive=-1;	// command being answered; -1 if none
+	bool _rspWaiting=false;			// waiting for pass/fail of _cmdActive
+	unsigned long _rspStart;
+	unsigned int _rspTimeout;
+	struct esp8266_link {
+		esp8266_tcp_state state;
+		bool connected;
+		uint16_t rxHead;	// rx ring read position
+		uint16_t rxCount;	// bytes in rx ring
+		uint16_t udpLeft;	// UDP: unread bytes of current datagram
+		uint16_t rxHeld;	// passive receive: bytes ESP8266 still holds for us
+#if ESP8266_ENABLE_POOL
+		uint32_t poolKey;	// our client links: host and port; 0: none
+		bool parked;		// idle in the pool, see tcpPark()
+		unsigned long parkedAt;	// millis()
+#endif
+	} _links[ESP8266_MAX_SOCK_NUM];
+	bool _serverStarted=false;
+	bool _wifiUp=false;			// see wifiConnected()
+#if ESP8266_ENABLE_SERVER
+	uint8_t _acceptQueue[ESP8266_MAX_SOCK_NUM];	// server links, oldest first
+	uint8_t _accepted=0;		// entries in _acceptQueue
+#endif
+	bool _mux=false;			// CIPMUX=1; otherwise single connection on link 0
+	bool _passthrough=false;	// CIPMODE=1 data mode, see tcpPassthroughStart()
+	bool _firstArg;				// no comma before next sendArg()
+	bool _ipdInfo=false;		// CIPDINFO=1, +IPD comes with sender address
+	bool _passiveRecv=false;	// CIPRECVMODE=1, see tcpPassiveRecv()
+	bool _recvLenStale=false;	// +IPD announced data since last CIPRECVLEN?
 	uint16_t _tcpServerPort;
-	uint16_t _tcpDataSize=0;	// 0: no tcp data to read
+	uint16_t _tcpDataSize=0;	// +IPD payload still in serial buffer; 0: none
+	uint8_t _tcpDataLink=0;		// link _tcpDataSize belongs to
+	unsigned long _lastRxMicros=0;	// when we read last byte
+	unsigned long _rxGapMicros=2083;	// see ESP8266_RX_GAP_CHARS; 9600 baud
+	unsigned long _baud=9600;
+	uint8_t _baudIndex;			// into baud rate table; ESP8266_BAUD_CUSTOM if not in it
+	uint8_t _baudFloor;			// lowest index we fall back to
+	uint8_t _rxErrors=0;		// net count, see ESP8266_BAUD_ERROR_LIMIT
+#if ESP8266_ENABLE_DNS_CACHE
+	struct esp8266_dns_entry {
+		uint32_t hash;			// of host name; 0: free
+		uint8_t ip[4];			// 0.0.0.0: name did not resolve
+		unsigned long expires;	// millis()
+	} _dns[ESP8266_DNS_CACHE_LEN];
+#endif
+#if ESP8266_ENABLE_FAST_JOIN
+	esp8266_join_cache _join;
+	unsigned long _joinStart;	// millis() of first command of current join
+	unsigned long _joinMillis=0;
+	bool _staticIp=false;		// CIPSTA_CUR in effect, DHCP is off
+#endif
+#if ESP8266_ENABLE_STATS
+	esp8266_stats _stats;
+#endif
 };
 
 extern Esp8266 esp8266;
 
+// dotted quad into buf of at least 16 chars; returns buf
+char * esp8266IpToStr(IPAddress ip, char * buf);
+
 #endif /* __esp8266_lib_h__ */
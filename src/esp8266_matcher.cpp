@@ -0,0 +1,76 @@
+/******************************************************************************
+******************************************************************************/
+
+#include <string.h>
+
+#include "esp8266_matcher.h"
+
+Esp8266Matcher::Esp8266Matcher()
+{
+	memset(_keys, 0, sizeof(_keys));
+	_count = 0;
+	restart();
+}
+
+void Esp8266Matcher::set(uint8_t slot, PGM_P keyword)
+{
+	if (slot >= ESP8266_MATCHER_MAX_KEYS) return;
+
+	_keys[slot] = keyword;
+	_pos[slot] = 0;
+	if (keyword && slot >= _count)
+		_count = slot + 1;
+}
+
+void Esp8266Matcher::restart()
+{
+	memset(_pos, 0, sizeof(_pos));
+}
+
+uint16_t Esp8266Matcher::feed(char c)
+{
+	uint16_t match = 0;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		PGM_P key = _keys[i];
+		if (key == NULL) continue;
+
+		uint8_t p = _pos[i];
+		char k = pgm_read_byte(key + p);
+		if (k != c) {
+			// common case: no partial match and byte does not start one
+			if (p == 0) continue;
+			// otherwise fall back to the longest border that still fits
+			do {
+				p = fallback(key, p);
+				k = pgm_read_byte(key + p);
+			} while (p > 0 && k != c);
+			if (k != c) {
+				_pos[i] = 0;
+				continue;
+			}
+		}
+
+		if (pgm_read_byte(key + ++p) == 0) {
+			match |= ESP8266_MATCH(i);
+			p = 0;
+		}
+		_pos[i] = p;
+	}
+
+	return match;
+}
+
+uint8_t Esp8266Matcher::fallback(PGM_P key, uint8_t pos)
+{
+	// keywords are short and partial mismatches are rare, so a brute
+	// force search beats keeping a failure table in RAM
+	for (uint8_t k = pos - 1; k > 0; k--) {
+		uint8_t i = 0;
+		while (i < k && pgm_read_byte(key + i) == pgm_read_byte(key + pos - k + i))
+			i++;
+		if (i == k)
+			return k;
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+/******************************************************************************
+esp8266_matcher.h
+
+Incremental multi-keyword matcher for the ESP8266 response stream.
+
+Instead of re-running strstr() over the whole receive buffer after every byte
+(quadratic in response length), all keywords we are waiting for are tracked
+at once.  Each keyword keeps the length of its longest prefix that is also a
+suffix of the input seen so far, so every received byte is examined exactly
+once per keyword.
+
+Keywords are identified by their slot number.  feed() returns a bit mask of
+the slots completed by the byte, so overlapping keywords such as "SEND OK\r\n"
+and "OK\r\n" are both reported.
+
+Keywords live in flash (PROGMEM) like the rest of the response tokens in
+esp8266_const.h.
+******************************************************************************/
+
+#ifndef __esp8266_matcher_h__
+#define __esp8266_matcher_h__
+
+#include <Arduino.h>
+
+#define ESP8266_MATCHER_MAX_KEYS 11
+#define ESP8266_MATCH(slot) ((uint16_t)1 << (slot))
+
+class Esp8266Matcher
+{
+public:
+	Esp8266Matcher();
+
+	// set keyword (in PROGMEM) for slot; NULL disables the slot
+	void set(uint8_t slot, PGM_P keyword);
+
+	// forget partial matches of all keywords, keep the keywords
+	void restart();
+
+	// feed next byte; return mask of slots (ESP8266_MATCH(slot)) whose
+	// keyword is completed by c, 0 if none
+	uint16_t feed(char c);
+
+private:
+	// length of longest proper border of keyword[0..pos)
+	static uint8_t fallback(PGM_P keyword, uint8_t pos);
+
+	PGM_P _keys[ESP8266_MATCHER_MAX_KEYS];
+	uint8_t _pos[ESP8266_MATCHER_MAX_KEYS];
+	uint8_t _count;		// highest used slot + 1
+};
+
+#endif /* __esp8266_matcher_h__ */
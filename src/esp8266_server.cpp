@@ -0,0 +1,90 @@
+/******************************************************************************
+******************************************************************************/
+
+#include <Arduino.h>
+#include "esp8266_server.h"
+#include "esp8266_lib.h"
+
+#if ESP8266_ENABLE_SERVER
+
+Esp8266Server::Esp8266Server(uint16_t port)
+{
+	_port = port;
+	_started = false;
+	_links = 0;
+	_next = 0;
+}
+
+void Esp8266Server::begin()
+{
+	if (_started) return;
+	_started = esp8266.tcpServerStart(_port) >= 0;
+}
+
+void Esp8266Server::end()
+{
+	if (!_started) return;
+	esp8266.tcpServerStop();
+	_started = false;
+}
+
+Esp8266Client Esp8266Server::accept()
+{
+	uint8_t link = esp8266.tcpAccept();
+	if (link == ESP8266_SOCK_NOT_AVAIL) return Esp8266Client();
+	return Esp8266Client(link);
+}
+
+// pick up new connections, including ones handed out by accept(), and
+// forget ones that are gone for good
+void Esp8266Server::collect()
+{
+	esp8266.poll();
+
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++) {
+		esp8266_tcp_state state = esp8266.tcpState(link);
+		if (state == ESP8266_TCP_SERVER) {
+			_links |= 1 << link;
+			continue;
+		}
+		// closed by remote but not read up yet is still ours
+		if (state == ESP8266_TCP_NONE && esp8266.tcpAvailable(link) > 0) continue;
+		_links &= ~(1 << link);
+	}
+}
+
+Esp8266Client Esp8266Server::available()
+{
+	collect();
+
+	for (uint8_t i = 0; i < ESP8266_MAX_SOCK_NUM; i++) {
+		uint8_t link = (_next + i) % ESP8266_MAX_SOCK_NUM;
+		if ((_links & (1 << link)) && esp8266.tcpAvailable(link) > 0) {
+			// next time start after this one so a busy client can't starve the others
+			_next = (link + 1) % ESP8266_MAX_SOCK_NUM;
+			return Esp8266Client(link);
+		}
+	}
+	return Esp8266Client();
+}
+
+size_t Esp8266Server::write(uint8_t b)
+{
+	return write(&b, 1);
+}
+
+size_t Esp8266Server::write(const uint8_t *buf, size_t size)
+{
+	collect();
+
+	// tcpWrite() caps its count at int16_t
+	esp8266_iovec iov = { buf, size, false };
+	size_t n = 0;
+	for (uint8_t link = 0; link < ESP8266_MAX_SOCK_NUM; link++) {
+		if (!(_links & (1 << link)) || !esp8266.tcpConnected(link)) continue;
+		if (esp8266.tcpWritev(link, &iov, 1) == (int32_t)size) n = size;
+	}
+	return n;
+}
+
+#endif /* ESP8266_ENABLE_SERVER */
@@ -0,0 +1,59 @@
+/******************************************************************************
+esp8266_server.h
+
+Arduino Server on top of Esp8266's TCP server.  ESP8266 accepts every
+connection by itself, on any free link; Esp8266 queues them in the order
+they came in (tcpAccept()) and this class hands them out as Esp8266Client
+objects, so a sketch can go on accepting while earlier clients are served.
+
+Two ways to use it, as with newer Arduino cores:
+  - accept() returns each new connection once; the sketch owns the client
+    and stop()s it when done.
+  - available() returns a connection that has data waiting, cycling over
+    all connections the server has seen, new or old.  The returned client
+    is a view of the link: it goes out of scope without closing it.
+Clients from either send each write right away; a sketch that turns on
+setWriteCoalescing() has to flush() before dropping the client.
+write() goes to every connected client of the server.
+******************************************************************************/
+
+#ifndef __esp8266_server_h__
+#define __esp8266_server_h__
+
+#include <Arduino.h>
+#include "Server.h"
+
+#include "esp8266_lib.h"
+#include "esp8266_client.h"
+
+#if ESP8266_ENABLE_SERVER
+
+class Esp8266Server : public Server {
+	
+public:
+	Esp8266Server(uint16_t port);
+
+	virtual void begin();
+	void end();		// stop listening; clients already connected stay
+	
+	Esp8266Client accept();		// new connection, or a not connected client
+	Esp8266Client available();	// connection with data waiting, or a not connected client
+
+	virtual size_t write(uint8_t);
+	virtual size_t write(const uint8_t *buf, size_t size);
+	using Print::write;
+
+	operator bool() { return _started; }
+
+private:
+	void collect();
+
+	uint16_t _port;
+	bool _started;
+	uint8_t _links;		// bit mask of our links, kept by collect()
+	uint8_t _next;		// where available() looks first
+};
+
+#endif /* ESP8266_ENABLE_SERVER */
+
+#endif /* __esp8266_server_h__ */
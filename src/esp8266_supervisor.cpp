@@ -0,0 +1,203 @@
+/******************************************************************************
+******************************************************************************/
+
+#include <Arduino.h>
+#include "esp8266_supervisor.h"
+#include "esp8266_lib.h"
+
+Esp8266Supervisor::Esp8266Supervisor()
+{
+	_ssid = NULL;
+	_pwd = NULL;
+	memset(&_wifi, 0, sizeof(_wifi));
+	_wifi.link = ESP8266_SOCK_NOT_AVAIL;
+	for (uint8_t i = 0; i < ESP8266_SUPERVISOR_LINKS; i++) {
+		memset(&_links[i], 0, sizeof(_links[i]));
+		_links[i].link = ESP8266_SOCK_NOT_AVAIL;
+	}
+	_pending = NULL;
+	_handle = -1;
+	_down = false;
+	_downSince = 0;
+	resetStats();
+}
+
+void Esp8266Supervisor::wifi(const char * ssid, const char * pwd)
+{
+	_ssid = ssid;
+	_pwd = pwd;
+	_wifi.up = false;
+	_wifi.failures = 0;
+	_wifi.due = millis();
+}
+
+bool Esp8266Supervisor::watch(uint8_t link, const char * host, uint16_t port, uint16_t keepAlive)
+{
+	if (link >= ESP8266_MAX_SOCK_NUM) return false;
+	esp8266_target * t = NULL;
+	for (uint8_t i = 0; i < ESP8266_SUPERVISOR_LINKS; i++) {
+		if (_links[i].link == link) {
+			t = &_links[i];
+			break;
+		}
+		if (t == NULL && _links[i].link == ESP8266_SOCK_NOT_AVAIL) t = &_links[i];
+	}
+	if (t == NULL) return false;
+	
+	t->link = link;
+	t->host = host;
+	t->port = port;
+	t->keepAlive = keepAlive;
+	t->up = esp8266.tcpConnected(link);
+	t->failures = 0;
+	t->due = millis();
+	return true;
+}
+
+void Esp8266Supervisor::unwatch(uint8_t link)
+{
+	for (uint8_t i = 0; i < ESP8266_SUPERVISOR_LINKS; i++) {
+		if (_links[i].link != link) continue;
+		// an attempt in flight is still collected, see handle(), but
+		// counts for no one
+		if (_pending == &_links[i]) _pending = NULL;
+		_links[i].link = ESP8266_SOCK_NOT_AVAIL;
+	}
+}
+
+void Esp8266Supervisor::handle()
+{
+	esp8266.poll();
+	unsigned long now = millis();
+	
+	// collected even if unwatched meanwhile, or its slot is never freed
+	if (_handle >= 0) {
+		int16_t result = esp8266.cmdResult(_handle);
+		if (result != ESP8266_RSP_PENDING) {
+			esp8266_target * t = _pending;
+			_pending = NULL;
+			_handle = -1;
+			if (t) done(*t, result, now);
+		}
+	}
+	
+	// notice what went down, and what came back
+	bool wifiUp = _ssid ? esp8266.wifiConnected() : true;
+	bool allUp = true;
+	if (_ssid && check(_wifi, wifiUp, now)) _stats.wifiDrops++;
+	allUp &= wifiUp;
+	for (uint8_t i = 0; i < ESP8266_SUPERVISOR_LINKS; i++) {
+		esp8266_target & t = _links[i];
+		if (t.link == ESP8266_SOCK_NOT_AVAIL) continue;
+		bool up = wifiUp && esp8266.tcpConnected(t.link);
+		if (check(t, up, now)) _stats.linkDrops++;
+		allUp &= up;
+	}
+	if (allUp && _down) {
+		_down = false;
+		_stats.lastDowntime = now - _downSince;
+		_stats.downtime += _stats.lastDowntime;
+	}
+	if (allUp || _handle >= 0) return;
+	
+	// one attempt at a time, AP first
+	if (!wifiUp) {
+		if ((long)(now - _wifi.due) >= 0) attempt(_wifi, now);
+		return;
+	}
+	for (uint8_t i = 0; i < ESP8266_SUPERVISOR_LINKS; i++) {
+		esp8266_target & t = _links[i];
+		if (t.link == ESP8266_SOCK_NOT_AVAIL || t.up) continue;
+		// busy with something else, e.g. connecting on behalf of the sketch
+		if (esp8266.tcpState(t.link) != ESP8266_TCP_NONE) continue;
+		// connecting wipes what the sketch has not read of the last one
+		if (esp8266.tcpAvailable(t.link) > 0) continue;
+		if ((long)(now - t.due) < 0) continue;
+		attempt(t, now);
+		return;
+	}
+}
+
+bool Esp8266Supervisor::up()
+{
+	if (_ssid && !esp8266.wifiConnected()) return false;
+	for (uint8_t i = 0; i < ESP8266_SUPERVISOR_LINKS; i++) {
+		if (_links[i].link != ESP8266_SOCK_NOT_AVAIL && !esp8266.tcpConnected(_links[i].link))
+			return false;
+	}
+	return true;
+}
+
+unsigned long Esp8266Supervisor::downFor()
+{
+	return _down ? millis() - _downSince : 0;
+}
+
+void Esp8266Supervisor::resetStats()
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+// t is up or not now; true if it just went down
+bool Esp8266Supervisor::check(esp8266_target & t, bool up, unsigned long now)
+{
+	bool wasUp = t.up;
+	t.up = up;
+	if (up || !wasUp) return false;
+	
+	// first try comes soon, but not from everybody at the same time
+	t.failures = 0;
+	t.due = now + random(ESP8266_BACKOFF_MIN);
+	if (!_down) {
+		_down = true;
+		_downSince = now;
+	}
+	return true;
+}
+
+void Esp8266Supervisor::attempt(esp8266_target & t, unsigned long now)
+{
+	if (t.link == ESP8266_SOCK_NOT_AVAIL)
+#if ESP8266_ENABLE_FAST_JOIN
+		_handle = esp8266.connectAPFastAsync(_ssid, _pwd);
+#else
+		_handle = esp8266.connectAPAsync(_ssid, _pwd);
+#endif
+	else
+		_handle = esp8266.tcpConnectAsync(t.link, t.host, t.port, t.keepAlive);
+	
+	// queue full: try again next time round
+	if (_handle < 0) {
+		done(t, _handle, now);
+		_handle = -1;
+		return;
+	}
+	_pending = &t;
+}
+
+void Esp8266Supervisor::done(esp8266_target & t, int16_t result, unsigned long now)
+{
+	if (result >= 0) {
+		t.failures = 0;
+		if (t.link == ESP8266_SOCK_NOT_AVAIL) _stats.wifiJoins++;
+		else _stats.linkConnects++;
+		return;
+	}
+	if (result == ESP8266_CMD_BAD) {
+		// never got out; not the network's fault
+		t.due = now;
+		return;
+	}
+	if (t.failures < 255) t.failures++;
+	t.due = now + backoff(t.failures);
+	_stats.failures++;
+}
+
+// wait after failures attempts in a row failed
+unsigned long Esp8266Supervisor::backoff(uint8_t failures)
+{
+	unsigned long b = ESP8266_BACKOFF_MIN;
+	while (--failures > 0 && b < ESP8266_BACKOFF_MAX) b <<= 1;
+	b = min(b, (unsigned long)ESP8266_BACKOFF_MAX);
+	return b - random(b / 2 + 1);
+}
@@ -0,0 +1,99 @@
+/******************************************************************************
+esp8266_supervisor.h
+
+Keeps us joined to an AP and a few client links connected, so the sketch
+does not need reconnect loops of its own.  Tell it what should be up, then
+call handle() from loop():
+
+	Esp8266Supervisor supervisor;
+	supervisor.wifi("ssid", "pwd");
+	supervisor.watch(0, "example.com", 80);
+	...
+	supervisor.handle();
+
+handle() polls, so it is all loop() needs, then only looks at state the
+library already keeps (WIFI DISCONNECT, WIFI GOT IP and <link>,CLOSED
+update it as they come in) and returns right away unless something is
+down and its next attempt is due.  Attempts use
+the async commands, one at a time, so the sketch's own commands keep going
+in between.  Links wait for the AP, which is joined with connectAPFast()
+where there is one.
+
+Something that went down is retried within a random fraction of
+ESP8266_BACKOFF_MIN.  After each failed attempt the wait doubles up to
+ESP8266_BACKOFF_MAX, of which a random half is taken off, so devices that
+lost the same AP don't all come back in step (seed random() with
+randomSeed() for that).  A link closed with data still unread is left
+alone until the sketch has read it all.  A link closed on purpose should
+be unwatch()ed first, or it is connected again.
+******************************************************************************/
+
+#ifndef __esp8266_supervisor_h__
+#define __esp8266_supervisor_h__
+
+#include <Arduino.h>
+
+#include "esp8266_lib.h"
+
+struct esp8266_supervisor_stats {
+	uint16_t wifiDrops;		// AP lost while we were joined
+	uint16_t wifiJoins;		// joins by the supervisor
+	uint16_t linkDrops;		// watched links closed
+	uint16_t linkConnects;	// connects by the supervisor
+	uint16_t failures;		// attempts that failed
+	// ms from something going down to all being up again
+	uint32_t downtime;		// all outages
+	uint32_t lastDowntime;	// most recent one
+};
+
+class Esp8266Supervisor {
+
+public:
+	Esp8266Supervisor();
+
+	// AP to stay joined to; NULL leaves joining to the sketch.  Strings
+	// must stay valid.
+	void wifi(const char * ssid, const char * pwd);
+	// keep link connected to host:port (see tcpConnect()); false if all
+	// ESP8266_SUPERVISOR_LINKS are watched already or link is out of range
+	bool watch(uint8_t link, const char * host, uint16_t port, uint16_t keepAlive = 0);
+	void unwatch(uint8_t link);
+
+	void handle();
+	// everything watched is up
+	bool up();
+	// ms since something went down; 0 while all is up
+	unsigned long downFor();
+
+	const esp8266_supervisor_stats & getStats() { return _stats; }
+	void resetStats();
+
+private:
+	// one thing to keep up, with its backoff
+	struct esp8266_target {
+		uint8_t link;		// ESP8266_SOCK_NOT_AVAIL: the AP; or not in use
+		const char * host;
+		uint16_t port;
+		uint16_t keepAlive;
+		bool up;			// as of last handle()
+		uint8_t failures;	// attempts failed in a row
+		unsigned long due;	// millis() of next attempt
+	};
+
+	bool check(esp8266_target & t, bool up, unsigned long now);
+	void attempt(esp8266_target & t, unsigned long now);
+	void done(esp8266_target & t, int16_t result, unsigned long now);
+	unsigned long backoff(uint8_t failures);
+
+	const char * _ssid;
+	const char * _pwd;
+	esp8266_target _wifi;
+	esp8266_target _links[ESP8266_SUPERVISOR_LINKS];
+	esp8266_target * _pending;	// whose attempt is in flight; NULL if unwatched since
+	esp8266_handle _handle;		// of the attempt in flight, -1 if none
+	bool _down;
+	unsigned long _downSince;
+	esp8266_supervisor_stats _stats;
+};
+
+#endif /* __esp8266_supervisor_h__ */
@@ -0,0 +1,51 @@
+/******************************************************************************
+******************************************************************************/
+
+#include <Arduino.h>
+#include "esp8266_trace.h"
+
+#if ESP8266_TRACE_LEN > 0
+
+esp8266_trace_entry esp8266TraceRing[ESP8266_TRACE_LEN];
+uint16_t esp8266TraceNext;
+bool esp8266TraceWrapped;
+
+void esp8266TraceDump(Print & out)
+{
+	uint16_t count = esp8266TraceWrapped ? ESP8266_TRACE_LEN : esp8266TraceNext;
+	uint16_t i = esp8266TraceWrapped ? esp8266TraceNext : 0;
+	
+	out.print(F("\r\n@trace "));
+	out.println(count, HEX);
+	while (count--) {
+		const esp8266_trace_entry & e = esp8266TraceRing[i];
+		out.print('@');
+		out.print(e.time, HEX);
+		out.print(' ');
+		out.print(e.type, HEX);
+		out.print(' ');
+		out.print(e.a, HEX);
+		out.print(' ');
+		out.println(e.b, HEX);
+		if (++i == ESP8266_TRACE_LEN) i = 0;
+	}
+	out.println(F("@end"));
+}
+
+void esp8266TraceClear()
+{
+	esp8266TraceNext = 0;
+	esp8266TraceWrapped = false;
+}
+
+#else
+
+void esp8266TraceDump(Print & out)
+{
+	out.println(F("@trace 0"));
+	out.println(F("@end"));
+}
+
+void esp8266TraceClear() {}
+
+#endif
@@ -0,0 +1,83 @@
+/******************************************************************************
+esp8266_trace.h
+
+In-RAM trace of what the driver does, for timing problems that go away as
+soon as Serial output is added.  Each record is 8 bytes (micros(), type,
+two arguments) written into a ring of ESP8266_TRACE_LEN entries; the
+oldest ones are overwritten.  Nothing is printed until esp8266TraceDump()
+is called, or an ASSERT fires (see esp8266_debug.h).
+
+Dumps are lines of hex numbers:
+
+	@trace <entries>
+	@<time> <type> <a> <b>
+	...
+	@end
+
+extras/host/esp8266_trace_decode turns them into a readable timeline.
+
+With ESP8266_TRACE_LEN 0 (default) ESP8266_TRACE() compiles to nothing.
+******************************************************************************/
+
+#ifndef __esp8266_trace_h__
+#define __esp8266_trace_h__
+
+#include <Arduino.h>
+
+#include "esp8266_config.h"
+
+// record types; the meaning of a and b depends on it.  Numbers are part of
+// the dump format, only add at the end
+enum esp8266_trace_type {
+	ESP8266_TRACE_CMD = 1,		// command sent: a op, b link
+	ESP8266_TRACE_MATCH,		// pass/fail token seen: a op, b match mask
+	ESP8266_TRACE_DONE,			// command completed: a op, b result
+	ESP8266_TRACE_TIMEOUT,		// no final answer: a op, b bytes received
+	ESP8266_TRACE_URC,			// async message: a event type | link << 4, b length
+	ESP8266_TRACE_OVERFLOW,		// serial port lost bytes
+	ESP8266_TRACE_DISCARD,		// payload dropped: a link, b bytes
+	ESP8266_TRACE_BAUD,			// baud rate changed: a table index
+	ESP8266_TRACE_ASSERT,		// failed ASSERT: b line
+	ESP8266_TRACE_USER			// for sketches: a, b as they like
+};
+
+struct esp8266_trace_entry {
+	uint32_t time;		// micros()
+	uint8_t type;		// esp8266_trace_type
+	uint8_t a;
+	uint16_t b;
+};
+
+#if ESP8266_TRACE_LEN > 0
+
+extern esp8266_trace_entry esp8266TraceRing[ESP8266_TRACE_LEN];
+extern uint16_t esp8266TraceNext;	// entry written next
+extern bool esp8266TraceWrapped;	// ring is full, next is the oldest
+
+// a handful of stores; no formatting, no serial output
+static inline void esp8266Trace(uint8_t type, uint8_t a, uint16_t b)
+{
+	esp8266_trace_entry & e = esp8266TraceRing[esp8266TraceNext];
+	e.time = micros();
+	e.type = type;
+	e.a = a;
+	e.b = b;
+	if (++esp8266TraceNext == ESP8266_TRACE_LEN) {
+		esp8266TraceNext = 0;
+		esp8266TraceWrapped = true;
+	}
+}
+
+#define ESP8266_TRACE(type, a, b) esp8266Trace(type, a, b)
+
+#else
+
+#define ESP8266_TRACE(type, a, b) do {} while (0)
+
+#endif
+
+// print ring, oldest first, and keep it; clear empties it
+void esp8266TraceDump(Print & out);
+void esp8266TraceClear();
+
+#endif /* __esp8266_trace_h__ */
@@ -0,0 +1,171 @@
+/******************************************************************************
+esp8266_transport.h
+
+Serial port the driver talks to ESP8266 over.  Can be
+
+	- a SoftwareSerial (on AVR, where the core ships one)
+	- a HardwareSerial, e.g. Serial1 on Mega/Leonardo/SAMD boards
+	- any other Stream, e.g. a host side simulator; such a stream can't be
+	  told a baud rate or report overflow by itself, so optional hooks
+	  provide that
+
+Bytes are moved one at a time, so the calls used per byte (available(),
+read(), write()) should not go through the Stream vtable.  For the two
+known serial classes we remember the type and call their methods
+qualified, which compiles to direct calls.  Only a generic Stream pays for
+the virtual call.
+******************************************************************************/
+
+#ifndef __esp8266_transport_h__
+#define __esp8266_transport_h__
+
+#include <Arduino.h>
+
+#include "esp8266_config.h"
+
+// cores that come with SoftwareSerial; define to 1 or 0 to override
+#ifndef ESP8266_SOFTWARE_SERIAL
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_MEGAAVR)
+#define ESP8266_SOFTWARE_SERIAL 1
+#else
+#define ESP8266_SOFTWARE_SERIAL 0
+#endif
+#endif
+
+#if ESP8266_SOFTWARE_SERIAL
+#include <SoftwareSerial.h>
+#endif
+
+// HardwareSerial is a concrete class on AVR only; elsewhere it is abstract
+// and we have to go through the virtual methods
+#if defined(ARDUINO_ARCH_AVR)
+#define ESP8266_HW_CALL(s, m) static_cast<HardwareSerial *>(s)->HardwareSerial::m
+#else
+#define ESP8266_HW_CALL(s, m) static_cast<HardwareSerial *>(s)->m
+#endif
+
+// for streams that are neither; either hook may be NULL
+struct esp8266_transport_hooks {
+	void (*begin)(Stream * stream, unsigned long baudRate);	// NULL: rate is fixed
+	bool (*overflow)(Stream * stream);	// true once after rx data was lost
+};
+
+class Esp8266Transport
+{
+public:
+#if ESP8266_SOFTWARE_SERIAL
+	Esp8266Transport(SoftwareSerial * s) : _stream(s), _kind(ESP8266_TRANSPORT_SOFTWARE), _hooks(NULL) {}
+#endif
+	Esp8266Transport(HardwareSerial * s) : _stream(s), _kind(ESP8266_TRANSPORT_HARDWARE), _hooks(NULL) {}
+	Esp8266Transport(Stream * s, const esp8266_transport_hooks * hooks = NULL)
+		: _stream(s), _kind(ESP8266_TRANSPORT_STREAM), _hooks(hooks) {}
+
+	void begin(unsigned long baudRate)
+	{
+		switch (_kind) {
+#if ESP8266_SOFTWARE_SERIAL
+		case ESP8266_TRANSPORT_SOFTWARE:
+			static_cast<SoftwareSerial *>(_stream)->begin(baudRate);
+			break;
+#endif
+		case ESP8266_TRANSPORT_HARDWARE:
+			static_cast<HardwareSerial *>(_stream)->begin(baudRate);
+			break;
+		default:
+			if (_hooks && _hooks->begin) _hooks->begin(_stream, baudRate);
+		}
+	}
+
+	// HardwareSerial silently drops what does not fit its buffer
+	bool overflow()
+	{
+#if ESP8266_SOFTWARE_SERIAL
+		if (_kind == ESP8266_TRANSPORT_SOFTWARE)
+			return static_cast<SoftwareSerial *>(_stream)->overflow();
+#endif
+		if (_kind == ESP8266_TRANSPORT_STREAM && _hooks && _hooks->overflow)
+			return _hooks->overflow(_stream);
+		return false;
+	}
+
+	int available()
+	{
+#if ESP8266_SOFTWARE_SERIAL
+		if (_kind == ESP8266_TRANSPORT_SOFTWARE)
+			return static_cast<SoftwareSerial *>(_stream)->SoftwareSerial::available();
+#endif
+		if (_kind == ESP8266_TRANSPORT_HARDWARE)
+			return ESP8266_HW_CALL(_stream, available)();
+		return _stream->available();
+	}
+
+	// callers check available() first, so every call counts as a byte
+	int read()
+	{
+#if ESP8266_ENABLE_STATS
+		rxBytes++;
+#endif
+#if ESP8266_SOFTWARE_SERIAL
+		if (_kind == ESP8266_TRANSPORT_SOFTWARE)
+			return static_cast<SoftwareSerial *>(_stream)->SoftwareSerial::read();
+#endif
+		if (_kind == ESP8266_TRANSPORT_HARDWARE)
+			return ESP8266_HW_CALL(_stream, read)();
+		return _stream->read();
+	}
+
+	size_t write(uint8_t c)
+	{
+#if ESP8266_ENABLE_STATS
+		txBytes++;
+#endif
+#if ESP8266_SOFTWARE_SERIAL
+		if (_kind == ESP8266_TRANSPORT_SOFTWARE)
+			return static_cast<SoftwareSerial *>(_stream)->SoftwareSerial::write(c);
+#endif
+		if (_kind == ESP8266_TRANSPORT_HARDWARE)
+			return ESP8266_HW_CALL(_stream, write)(c);
+		return _stream->write(c);
+	}
+
+	// payload; the serial classes write byte by byte anyway, a generic
+	// stream may have something better
+	size_t write(const uint8_t * buf, size_t size)
+	{
+		if (_kind == ESP8266_TRANSPORT_STREAM) {
+#if ESP8266_ENABLE_STATS
+			txBytes += size;
+#endif
+			return _stream->write(buf, size);
+		}
+		size_t n = 0;
+		while (size--) n += write(*buf++);
+		return n;
+	}
+
+	// AT commands; not worth optimizing
+#if ESP8266_ENABLE_STATS
+	template <class T> size_t print(T x) { size_t n = _stream->print(x); txBytes += n; return n; }
+	template <class T> size_t println(T x) { size_t n = _stream->println(x); txBytes += n; return n; }
+	
+	// serial traffic, for esp8266_stats
+	uint32_t rxBytes = 0;
+	uint32_t txBytes = 0;
+#else
+	template <class T> size_t print(T x) { return _stream->print(x); }
+	template <class T> size_t println(T x) { return _stream->println(x); }
+#endif
+
+private:
+	enum esp8266_transport_kind {
+		ESP8266_TRANSPORT_STREAM,
+		ESP8266_TRANSPORT_HARDWARE,
+		ESP8266_TRANSPORT_SOFTWARE
+	};
+
+	Stream * _stream;
+	uint8_t _kind;		// esp8266_transport_kind
+	const esp8266_transport_hooks * _hooks;
+};
+
+#endif /* __esp8266_transport_h__ */
@@ -0,0 +1,142 @@
+/******************************************************************************
+******************************************************************************/
+
+#include <Arduino.h>
+#include "esp8266_udp.h"
+#include "esp8266_lib.h"
+
+#if ESP8266_ENABLE_UDP
+
+Esp8266UDP::Esp8266UDP()
+{
+	_link = ESP8266_SOCK_NOT_AVAIL;
+	_listening = false;
+	_txLen = 0;
+	_txOverflow = false;
+	_txHost = NULL;
+	_txPort = 0;
+	_remotePort = 0;
+}
+
+uint8_t Esp8266UDP::begin(uint16_t port)
+{
+	stop();
+	
+	uint8_t link = esp8266.getFreeLink();
+	if (link == ESP8266_SOCK_NOT_AVAIL) return 0;
+	
+	// no fixed remote; mode 2 lets it follow whoever sends to us
+	if (esp8266.udpOpen(link, "0.0.0.0", 0, port, 2) < 0) return 0;
+	_link = link;
+	_listening = true;
+	return 1;
+}
+
+void Esp8266UDP::stop()
+{
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return;
+	esp8266.tcpClose(_link);
+	_link = ESP8266_SOCK_NOT_AVAIL;
+	_listening = false;
+}
+
+int Esp8266UDP::beginPacket(IPAddress ip, uint16_t port)
+{
+	esp8266IpToStr(ip, _txIP);
+	return startPacket(port);
+}
+
+int Esp8266UDP::beginPacket(const char *host, uint16_t port)
+{
+	// CIPSEND takes a dotted address only, not a name
+#if ESP8266_ENABLE_DNS_CACHE
+	IPAddress ip;
+	if (esp8266.resolve(host, ip) < 0) return 0;
+	return beginPacket(ip, port);
+#else
+	size_t n = strlen(host);
+	if (n == 0 || n >= sizeof(_txIP) || strspn(host, "0123456789.") != n) return 0;
+	memcpy(_txIP, host, n + 1);
+	return startPacket(port);
+#endif
+}
+
+// _txIP holds the destination
+int Esp8266UDP::startPacket(uint16_t port)
+{
+	if (_link == ESP8266_SOCK_NOT_AVAIL) {
+		uint8_t link = esp8266.getFreeLink();
+		if (link == ESP8266_SOCK_NOT_AVAIL) return 0;
+		if (esp8266.udpOpen(link, _txIP, port) < 0) return 0;
+		_link = link;
+	}
+	
+	_txHost = _txIP;
+	_txPort = port;
+	_txLen = 0;
+	_txOverflow = false;
+	return 1;
+}
+
+int Esp8266UDP::endPacket()
+{
+	if (_link == ESP8266_SOCK_NOT_AVAIL || _txHost == NULL) return 0;
+	
+	// a truncated datagram is worse than none
+	int16_t ret = 0;
+	if (!_txOverflow && _txLen > 0)
+		ret = esp8266.udpWrite(_link, _txBuf, _txLen, _txHost, _txPort);
+	_txHost = NULL;
+	_txLen = 0;
+	return ret > 0;
+}
+
+size_t Esp8266UDP::write(uint8_t c)
+{
+	return write(&c, 1);
+}
+
+size_t Esp8266UDP::write(const uint8_t *buf, size_t size)
+{
+	if (_txHost == NULL) return 0;
+	if (_txLen + size > ESP8266_UDP_TX_BUFFER_LEN) {
+		_txOverflow = true;
+		return 0;
+	}
+	memcpy(_txBuf + _txLen, buf, size);
+	_txLen += size;
+	return size;
+}
+
+int Esp8266UDP::parsePacket()
+{
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return 0;
+	int16_t size = esp8266.udpParse(_link, _remoteIP, _remotePort);
+	return size < 0 ? 0 : size;
+}
+
+int Esp8266UDP::available()
+{
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return 0;
+	return esp8266.tcpAvailable(_link);
+}
+
+int Esp8266UDP::read()
+{
+	uint8_t c;
+	return read(&c, 1) == 1 ? c : -1;
+}
+
+int Esp8266UDP::read(unsigned char *buf, size_t len)
+{
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return -1;
+	return esp8266.tcpRead(_link, buf, len);
+}
+
+int Esp8266UDP::peek()
+{
+	if (_link == ESP8266_SOCK_NOT_AVAIL) return -1;
+	return esp8266.tcpPeek(_link);
+}
+
+#endif
@@ -0,0 +1,67 @@
+/******************************************************************************
+esp8266_udp.h
+
+Arduino UDP on top of Esp8266's UDP links.  Each object holds one link.
+begin() listens on a local port and replies go wherever beginPacket()
+says; without begin(), the first beginPacket() opens a send-only link.
+A datagram is collected in the object between beginPacket() and
+endPacket() (up to ESP8266_UDP_TX_BUFFER_LEN bytes) and goes out as one
+CIPSEND.
+******************************************************************************/
+
+#ifndef __esp8266_udp_h__
+#define __esp8266_udp_h__
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include "Udp.h"
+
+#include "esp8266_lib.h"
+
+#if ESP8266_ENABLE_UDP
+
+class Esp8266UDP : public UDP {
+	
+public:
+	Esp8266UDP();
+
+	virtual uint8_t begin(uint16_t port);	// 1 on success
+	virtual void stop();
+
+	virtual int beginPacket(IPAddress ip, uint16_t port);
+	virtual int beginPacket(const char *host, uint16_t port);	// name needs ESP8266_ENABLE_DNS_CACHE
+	virtual int endPacket();	// 1 if sent
+	virtual size_t write(uint8_t);
+	virtual size_t write(const uint8_t *buf, size_t size);
+	using Print::write;
+
+	virtual int parsePacket();	// size of next datagram, 0 if none
+	virtual int available();
+	virtual int read();
+	virtual int read(unsigned char *buf, size_t len);
+	virtual int read(char *buf, size_t len) { return read((unsigned char *)buf, len); }
+	virtual int peek();
+	virtual void flush() {}
+	virtual IPAddress remoteIP() { return _remoteIP; }
+	virtual uint16_t remotePort() { return _remotePort; }
+	
+	uint8_t link() { return _link; }
+
+private:
+	int startPacket(uint16_t port);
+	
+	uint8_t _link;		// ESP8266_SOCK_NOT_AVAIL when not open
+	bool _listening;	// opened by begin()
+	uint8_t _txBuf[ESP8266_UDP_TX_BUFFER_LEN];
+	uint16_t _txLen;
+	bool _txOverflow;	// datagram did not fit _txBuf
+	const char * _txHost;	// _txIP between beginPacket() and endPacket(), else NULL
+	char _txIP[16];		// destination, dotted
+	uint16_t _txPort;
+	IPAddress _remoteIP;	// sender of current datagram
+	uint16_t _remotePort;
+};
+
+#endif
+
+#endif /* __esp8266_udp_h__ */